@@ -0,0 +1,122 @@
+// allocstats.cpp
+#include "allocstats.h"
+#include "framearena.h"
+
+#include <atomic>
+#include <cassert>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+#include <sqlite3.h>
+
+namespace {
+std::atomic<std::uint64_t> g_allocs{0};
+std::atomic<std::uint64_t> g_frees{0};
+thread_local std::uint64_t t_allocs = 0;
+
+void count_alloc() {
+    g_allocs.fetch_add(1, std::memory_order_relaxed);
+    ++t_allocs;
+}
+
+void* counted_malloc(std::size_t n) {
+    // inside a FrameArena::Region this thread bump-allocates instead
+    if (void* a = FrameArena::thread_allocate(n ? n : 1)) return a;
+    void* p = std::malloc(n ? n : 1);
+    if (!p) throw std::bad_alloc();
+    count_alloc();
+    return p;
+}
+
+void* counted_aligned(std::size_t n, std::align_val_t al) {
+    std::size_t a = static_cast<std::size_t>(al);
+    std::size_t size = n ? (n + a - 1) / a * a : a;
+#ifdef _WIN32
+    void* p = _aligned_malloc(size, a);
+#else
+    void* p = std::aligned_alloc(a, size);
+#endif
+    if (!p) throw std::bad_alloc();
+    count_alloc();
+    return p;
+}
+
+void counted_free(void* p) noexcept {
+    if (!p || FrameArena::thread_release(p)) return;
+    // arena memory freed on another thread would land in std::free here
+    assert(!FrameArena::in_any_arena(p));
+    g_frees.fetch_add(1, std::memory_order_relaxed);
+    std::free(p);
+}
+
+void counted_aligned_free(void* p) noexcept {
+    if (!p) return;
+    g_frees.fetch_add(1, std::memory_order_relaxed);
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    std::free(p);
+#endif
+}
+// SQLite's allocator: plain malloc (never the arena) with the size kept in
+// an 8-byte header for xSize, which also keeps SQLite's 8-byte alignment
+void* sqlite_malloc(int n) {
+    auto* h = static_cast<std::int64_t*>(std::malloc(static_cast<std::size_t>(n) + sizeof(std::int64_t)));
+    if (!h) return nullptr;
+    count_alloc();
+    h[0] = n;
+    return h + 1;
+}
+
+void sqlite_free(void* p) {
+    if (!p) return;
+    g_frees.fetch_add(1, std::memory_order_relaxed);
+    std::free(static_cast<std::int64_t*>(p) - 1);
+}
+
+// counted as a free plus an alloc so allocs - frees stays the live count
+void* sqlite_realloc(void* p, int n) {
+    auto* h = static_cast<std::int64_t*>(std::realloc(static_cast<std::int64_t*>(p) - 1,
+                                                      static_cast<std::size_t>(n) + sizeof(std::int64_t)));
+    if (!h) return nullptr;
+    g_frees.fetch_add(1, std::memory_order_relaxed);
+    count_alloc();
+    h[0] = n;
+    return h + 1;
+}
+
+int sqlite_size(void* p) { return p ? static_cast<int>(static_cast<std::int64_t*>(p)[-1]) : 0; }
+int sqlite_roundup(int n) { return (n + 7) & ~7; }
+int sqlite_init(void*) { return SQLITE_OK; }
+void sqlite_shutdown(void*) {}
+} // namespace
+
+namespace alloc_stats {
+
+std::uint64_t allocs() { return g_allocs.load(std::memory_order_relaxed); }
+std::uint64_t frees() { return g_frees.load(std::memory_order_relaxed); }
+std::uint64_t thread_allocs() { return t_allocs; }
+
+bool count_sqlite() {
+    static const sqlite3_mem_methods methods = {
+        sqlite_malloc, sqlite_free, sqlite_realloc, sqlite_size,
+        sqlite_roundup, sqlite_init, sqlite_shutdown, nullptr};
+    int rc = sqlite3_config(SQLITE_CONFIG_MALLOC, &methods);
+    if (rc != SQLITE_OK) {
+        std::cerr << "sqlite allocator hook failed: " << sqlite3_errstr(rc) << "\n";
+        return false;
+    }
+    return true;
+}
+
+} // namespace alloc_stats
+
+// array and nothrow forms forward to these in the standard library
+void* operator new(std::size_t n) { return counted_malloc(n); }
+void operator delete(void* p) noexcept { counted_free(p); }
+void operator delete(void* p, std::size_t) noexcept { counted_free(p); }
+
+void* operator new(std::size_t n, std::align_val_t al) { return counted_aligned(n, al); }
+void operator delete(void* p, std::align_val_t) noexcept { counted_aligned_free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { counted_aligned_free(p); }
@@ -0,0 +1,23 @@
+#ifndef ALLOCSTATS_H
+#define ALLOCSTATS_H
+
+#include <cstdint>
+
+// Heap counters fed by the replacement global operator new/delete in
+// allocstats.cpp (linked into the server only) and, once count_sqlite() has
+// run, by SQLite's allocator too. Allocations served by a FrameArena are not
+// heap allocations and are not counted. thread_allocs() counts the calling
+// thread alone; the connection loop diffs it per frame.
+namespace alloc_stats {
+
+std::uint64_t allocs();
+std::uint64_t frees();
+std::uint64_t thread_allocs();
+
+// SQLite calls malloc directly, past operator new; this installs counting
+// SQLITE_CONFIG_MALLOC hooks. Call before any other SQLite use.
+bool count_sqlite();
+
+} // namespace alloc_stats
+
+#endif
@@ -0,0 +1,127 @@
+// bench_chat.cpp
+// Drives a running server: `receivers` clients join one room, a sender
+// posts `messages` messages, and the /stats counters are diffed around the
+// run to show heap allocations per frame once warmed up.
+// usage: bench_chat [port=8080] [receivers=50] [messages=2000]
+#include <iostream>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/beast/websocket.hpp>
+#include <boost/asio.hpp>
+#include <nlohmann/json.hpp>
+
+namespace beast = boost::beast;
+namespace http  = beast::http;
+namespace websocket = beast::websocket;
+namespace net   = boost::asio;
+using tcp = net::ip::tcp;
+using json = nlohmann::json;
+
+static tcp::endpoint local(unsigned short port) {
+    return {net::ip::make_address("127.0.0.1"), port};
+}
+
+static json fetch_stats(unsigned short port) {
+    net::io_context ioc;
+    beast::tcp_stream stream(ioc);
+    stream.connect(local(port));
+    http::request<http::empty_body> req{http::verb::get, "/stats", 11};
+    req.set(http::field::host, "127.0.0.1");
+    http::write(stream, req);
+    beast::flat_buffer buf;
+    http::response<http::string_body> res;
+    http::read(stream, buf, res);
+    return json::parse(res.body());
+}
+
+static std::unique_ptr<websocket::stream<tcp::socket>> join(net::io_context& ioc, unsigned short port,
+                                                            const std::string& name) {
+    auto ws = std::make_unique<websocket::stream<tcp::socket>>(ioc);
+    ws->next_layer().connect(local(port));
+    ws->handshake("127.0.0.1", "/");
+    ws->write(net::buffer(json{{"type", "join"}, {"username", name}, {"room", "bench"}}.dump()));
+    return ws;
+}
+
+// sends `count` messages and waits until every receiver has seen them all
+static double run_batch(websocket::stream<tcp::socket>& sender, int count, int receivers,
+                        std::atomic<long long>& received) {
+    long long target = received.load() + static_cast<long long>(count) * receivers;
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; ++i) {
+        sender.write(net::buffer(json{{"type", "message"}, {"text", "bench message " + std::to_string(i)}}.dump()));
+    }
+    while (received.load() < target) std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+int main(int argc, char** argv) {
+    unsigned short port = static_cast<unsigned short>(argc > 1 ? std::atoi(argv[1]) : 8080);
+    int receivers = argc > 2 ? std::atoi(argv[2]) : 50;
+    int messages = argc > 3 ? std::atoi(argv[3]) : 2000;
+    if (receivers <= 0 || messages <= 0) {
+        std::cerr << "usage: bench_chat [port] [receivers] [messages]\n";
+        return 1;
+    }
+
+    try {
+        std::atomic<long long> received{0};
+        std::atomic<int> joined{0};
+        std::vector<std::thread> threads;
+        for (int r = 0; r < receivers; ++r) {
+            threads.emplace_back([&, r] {
+                net::io_context ioc;
+                auto ws = join(ioc, port, "recv" + std::to_string(r));
+                ++joined;
+                beast::flat_buffer buf;
+                beast::error_code ec;
+                for (;;) {
+                    ws->read(buf, ec);
+                    if (ec) return;
+                    if (beast::buffers_to_string(buf.data()).find("\"type\":\"message\"") != std::string::npos) ++received;
+                    buf.consume(buf.size());
+                }
+            });
+        }
+        while (joined.load() < receivers) std::this_thread::sleep_for(std::chrono::milliseconds(5));
+
+        net::io_context ioc;
+        auto sender = join(ioc, port, "sender");
+        // let the joins and presence updates settle before measuring
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+        run_batch(*sender, std::min(messages, 200), receivers, received);
+
+        json before = fetch_stats(port);
+        double secs = run_batch(*sender, messages, receivers, received);
+        json after = fetch_stats(port);
+
+        auto frames = after["frames"]["count"].get<long long>() - before["frames"]["count"].get<long long>();
+        auto frame_allocs = after["frames"]["heap_allocs"].get<long long>() - before["frames"]["heap_allocs"].get<long long>();
+        auto heap = after["heap"]["allocs"].get<long long>() - before["heap"]["allocs"].get<long long>();
+        auto overflow = after["arena"]["overflow_allocs"].get<long long>() - before["arena"]["overflow_allocs"].get<long long>();
+
+        std::cout << messages << " messages x " << receivers << " receivers in " << secs << " s ("
+                  << static_cast<long long>(messages / secs) << " msg/s)\n"
+                  << "frames " << frames << ", heap allocs during frames " << frame_allocs
+                  << " (" << (frames ? static_cast<double>(frame_allocs) / frames : 0.0) << "/frame)"
+                  << ", arena overflows " << overflow << "\n"
+                  << "process-wide heap allocs " << heap << " ("
+                  << static_cast<double>(heap) / messages << "/message)\n";
+
+        for (auto& t : threads) t.detach();
+        return 0;
+    } catch (const std::exception& e) {
+        std::cerr << "bench_chat: " << e.what() << "\n";
+        return 1;
+    }
+}
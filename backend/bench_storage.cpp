@@ -0,0 +1,70 @@
+// bench_storage.cpp
+// Ingest / history-read throughput of the storage backends.
+// usage: bench_storage [messages=200000] [rooms=50]
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <filesystem>
+#include <cstdlib>
+
+#include "database.h"
+
+namespace fs = std::filesystem;
+using bench_clock = std::chrono::steady_clock;
+
+static double seconds_since(bench_clock::time_point t0) {
+    return std::chrono::duration<double>(bench_clock::now() - t0).count();
+}
+
+static void run(const char* name, StorageBackend backend, const std::string& path, int messages, int rooms) {
+    std::error_code ec;
+    fs::remove_all(path, ec);
+    fs::remove(path + "-wal", ec);
+    fs::remove(path + "-shm", ec);
+
+    Database db(path, backend);
+    if (!db.open()) {
+        std::cerr << name << ": open failed\n";
+        return;
+    }
+
+    std::string text(120, 'x');
+    auto t0 = bench_clock::now();
+    for (int i = 0; i < messages; ++i) {
+        db.insert_message("room" + std::to_string(i % rooms), "user" + std::to_string(i % 997), text, i);
+    }
+    double ingest = seconds_since(t0);
+
+    const int reads = 1000;
+    std::size_t got = 0;
+    t0 = bench_clock::now();
+    for (int i = 0; i < reads; ++i) {
+        got += db.get_recent_messages("room" + std::to_string(i % rooms), 50).size();
+    }
+    double read = seconds_since(t0);
+    db.close();
+
+    t0 = bench_clock::now();
+    Database reopened(path, backend);
+    reopened.open();
+    double reopen = seconds_since(t0);
+
+    std::cout << name << ": ingest " << static_cast<long long>(messages / ingest) << " msg/s"
+              << ", get_recent(50) " << static_cast<long long>(reads / read) << " calls/s"
+              << " (" << got / reads << " rows avg)"
+              << ", reopen " << reopen * 1000 << " ms\n";
+}
+
+int main(int argc, char** argv) {
+    int messages = argc > 1 ? std::atoi(argv[1]) : 200000;
+    int rooms = argc > 2 ? std::atoi(argv[2]) : 50;
+    if (messages <= 0 || rooms <= 0) {
+        std::cerr << "usage: bench_storage [messages] [rooms]\n";
+        return 1;
+    }
+
+    fs::path dir = fs::temp_directory_path();
+    run("sqlite", StorageBackend::Sqlite, (dir / "bench_messages.db").string(), messages, rooms);
+    run("log   ", StorageBackend::Log, (dir / "bench_messages.log").string(), messages, rooms);
+    return 0;
+}
@@ -0,0 +1,90 @@
+// broadcastexecutor.cpp
+#include "broadcastexecutor.h"
+
+#include <iostream>
+#include <algorithm>
+
+namespace {
+// lets submit() from inside a task go to the caller's own deque
+thread_local const BroadcastExecutor* tl_owner = nullptr;
+thread_local unsigned tl_index = 0;
+}
+
+BroadcastExecutor::BroadcastExecutor(unsigned threads) {
+    threads = std::max(threads, 1u);
+    for (unsigned i = 0; i < threads; ++i) workers_.push_back(std::make_unique<Worker>());
+    for (unsigned i = 0; i < threads; ++i) threads_.emplace_back([this, i] { run(i); });
+}
+
+BroadcastExecutor::~BroadcastExecutor() {
+    {
+        std::lock_guard<std::mutex> lock(idle_mtx_);
+        stop_ = true;
+    }
+    idle_cv_.notify_all();
+    for (auto& t : threads_) t.join();
+}
+
+void BroadcastExecutor::submit(Task task) {
+    unsigned target = tl_owner == this
+        ? tl_index
+        : next_.fetch_add(1, std::memory_order_relaxed) % size();
+    // count first so a worker that takes it right away never drives pending_ below zero
+    {
+        std::lock_guard<std::mutex> lock(idle_mtx_);
+        ++pending_;
+    }
+    {
+        std::lock_guard<std::mutex> lock(workers_[target]->mtx);
+        workers_[target]->tasks.push_back(std::move(task));
+    }
+    idle_cv_.notify_one();
+}
+
+bool BroadcastExecutor::pop_or_steal(unsigned self, Task& out) {
+    {
+        Worker& own = *workers_[self];
+        std::lock_guard<std::mutex> lock(own.mtx);
+        if (!own.tasks.empty()) {
+            out = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+    for (unsigned k = 1; k < size(); ++k) {
+        Worker& victim = *workers_[(self + k) % size()];
+        std::lock_guard<std::mutex> lock(victim.mtx);
+        if (!victim.tasks.empty()) {
+            out = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void BroadcastExecutor::run(unsigned self) {
+    tl_owner = this;
+    tl_index = self;
+    for (;;) {
+        Task task;
+        if (pop_or_steal(self, task)) {
+            {
+                std::lock_guard<std::mutex> lock(idle_mtx_);
+                --pending_;
+            }
+            try {
+                task();
+            } catch (const std::exception& e) {
+                std::cerr << "broadcast task error: " << e.what() << "\n";
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(idle_mtx_);
+        // pending_ can briefly count a task that is not pushed yet;
+        // the next pop_or_steal then just comes back empty
+        idle_cv_.wait(lock, [this] { return stop_ || pending_ > 0; });
+        if (stop_ && pending_ == 0) return;
+    }
+}
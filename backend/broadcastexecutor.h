@@ -0,0 +1,52 @@
+#ifndef BROADCASTEXECUTOR_H
+#define BROADCASTEXECUTOR_H
+
+#include <functional>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+
+// Small work-stealing pool for socket fan-out. Every worker owns a deque:
+// it pushes/pops its own work at the back and, when empty, steals from the
+// front of the others. Tasks submitted from outside the pool are spread
+// round-robin. No ordering is guaranteed between tasks; callers that need it
+// (room broadcasts) sequence on top, see SessionManager.
+class BroadcastExecutor {
+public:
+    using Task = std::function<void()>;
+
+    explicit BroadcastExecutor(unsigned threads);
+    // runs everything still queued, then joins the workers
+    ~BroadcastExecutor();
+
+    BroadcastExecutor(const BroadcastExecutor&) = delete;
+    BroadcastExecutor& operator=(const BroadcastExecutor&) = delete;
+
+    void submit(Task task);
+    unsigned size() const { return static_cast<unsigned>(workers_.size()); }
+
+private:
+    struct Worker {
+        std::mutex mtx;
+        std::deque<Task> tasks;
+    };
+
+    bool pop_or_steal(unsigned self, Task& out);
+    void run(unsigned self);
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::thread> threads_;
+    std::atomic<unsigned> next_{0};
+
+    // sleeping workers wait here until pending_ > 0
+    std::mutex idle_mtx_;
+    std::condition_variable idle_cv_;
+    std::size_t pending_ = 0;
+    bool stop_ = false;
+};
+
+#endif
@@ -0,0 +1,41 @@
+// bufferpool.cpp
+#include "bufferpool.h"
+
+BufferPool::BufferPool(std::size_t max_message, std::size_t max_pooled)
+    : max_message_(max_message), max_pooled_(max_pooled) {
+    free_.reserve(max_pooled);
+}
+
+BufferPool::Handle BufferPool::acquire() {
+    std::unique_ptr<boost::beast::flat_buffer> buf;
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        if (!free_.empty()) {
+            buf = std::move(free_.back());
+            free_.pop_back();
+            ++reused_;
+        } else {
+            ++created_;
+        }
+    }
+    if (!buf) {
+        buf = std::make_unique<boost::beast::flat_buffer>(max_message_);
+        // a first read of any size up to the cap won't need to grow it
+        buf->reserve(max_message_);
+    }
+    return Handle(buf.release(), Releaser{this});
+}
+
+void BufferPool::release(boost::beast::flat_buffer* raw) {
+    std::unique_ptr<boost::beast::flat_buffer> buf(raw);
+    buf->consume(buf->size());
+    if (buf->capacity() > max_message_) return;
+
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (free_.size() < max_pooled_) free_.push_back(std::move(buf));
+}
+
+BufferPool::Stats BufferPool::stats() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    return Stats{created_, reused_, free_.size()};
+}
@@ -0,0 +1,49 @@
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <cstdint>
+#include <boost/beast/core/flat_buffer.hpp>
+
+// Recycles websocket read buffers between connections. Every buffer is
+// capped at max_message bytes (reads past that fail instead of growing),
+// and only buffers whose capacity stayed within that cap go back in the
+// pool, so an idle server holds at most max_pooled * max_message bytes.
+class BufferPool {
+    struct Releaser {
+        BufferPool* pool;
+        void operator()(boost::beast::flat_buffer* buf) const { pool->release(buf); }
+    };
+
+public:
+    using Handle = std::unique_ptr<boost::beast::flat_buffer, Releaser>;
+
+    BufferPool(std::size_t max_message, std::size_t max_pooled);
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    Handle acquire();
+    std::size_t max_message() const { return max_message_; }
+
+    struct Stats {
+        std::uint64_t created;
+        std::uint64_t reused;
+        std::size_t pooled;
+    };
+    Stats stats();
+
+private:
+    void release(boost::beast::flat_buffer* buf);
+
+    std::size_t max_message_;
+    std::size_t max_pooled_;
+    std::mutex mtx_;
+    std::vector<std::unique_ptr<boost::beast::flat_buffer>> free_;
+    std::uint64_t created_ = 0;
+    std::uint64_t reused_ = 0;
+};
+
+#endif
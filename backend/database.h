@@ -3,8 +3,12 @@
 
 #include <string>
 #include <vector>
+#include <memory>
+#include <functional>
+#include <thread>
 #include <mutex>
-#include <sqlite3.h>
+#include <condition_variable>
+#include <atomic>
 
 struct ChatMessage {
     std::string username;
@@ -13,26 +17,54 @@ struct ChatMessage {
     std::string room;
 };
 
+// Storage engine interface. Implementations do their own locking, Database
+// only forwards to whichever one was picked at startup.
+class MessageStore {
+public:
+    virtual ~MessageStore() = default;
+
+    virtual bool open() = 0;
+    virtual bool close() = 0;
+    // oldest -> newest, at most `limit` entries
+    virtual std::vector<ChatMessage> get_recent_messages(const std::string &room, int limit) = 0;
+    virtual void insert_message(const std::string& room, const std::string& username, const std::string& text, long long ts) = 0;
+};
+
+enum class StorageBackend {
+    Sqlite,   // messages table in a single SQLite file (default)
+    Log       // segmented append-only log directory, see logstore.h
+};
+
+// "sqlite" / "log" -> backend; returns false for anything else
+bool parse_storage_backend(const std::string& name, StorageBackend& out);
+
 class Database {
 public:
-    Database(const std::string& path);
+    Database(const std::string& path, StorageBackend backend = StorageBackend::Sqlite);
     ~Database();
 
 
     // these commands remove the copy constructor
     Database(const Database&) = delete;
     Database& operator=(const Database&) = delete;
-    
+
     bool open();
+    // Calls wait() and then open() on a background thread, then done(ok).
+    // Reads and inserts made meanwhile block until the store is open, so a
+    // hot-restarted server can accept connections while the previous process
+    // still holds the store.
+    void open_async(std::function<void()> wait, std::function<void(bool)> done);
     bool close();
     std::vector<ChatMessage> get_recent_messages(const std::string &room, int limit = 100);
     void insert_message(const std::string& room, const std::string& username, const std::string& text, long long ts);
 private:
-    bool ensure_table();
+    void wait_opened();
 
-    std::string path_;
-    sqlite3* db_ = nullptr;
-    std::mutex mtx_;
+    std::unique_ptr<MessageStore> store_;
+    std::thread opener_;
+    std::mutex open_mtx_;
+    std::condition_variable open_cv_;
+    std::atomic<bool> opening_{false};
 };
 
 #endif
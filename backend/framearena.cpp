@@ -0,0 +1,102 @@
+// framearena.cpp
+#include "framearena.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+
+namespace {
+// the arena bound to this thread, and whether a Region is open on it
+thread_local FrameArena* tl_arena = nullptr;
+thread_local bool tl_active = false;
+
+std::atomic<std::uint64_t> g_resets{0};
+std::atomic<std::uint64_t> g_overflow{0};
+std::atomic<std::size_t> g_high_water{0};
+
+constexpr std::size_t kAlign = alignof(std::max_align_t);
+
+#ifndef NDEBUG
+// every live arena, intrusively linked: operator delete consults this list,
+// so keeping it must not allocate
+std::mutex g_arenas_mtx;
+FrameArena* g_arenas = nullptr;
+#endif
+}
+
+FrameArena::FrameArena(std::size_t capacity)
+    // malloc, not new: the block itself must not be mistaken for arena memory
+    : block_(static_cast<char*>(std::malloc(capacity))), capacity_(capacity) {
+    if (!block_) throw std::bad_alloc();
+#ifndef NDEBUG
+    {
+        std::lock_guard<std::mutex> lock(g_arenas_mtx);
+        next_ = g_arenas;
+        if (next_) next_->prev_ = this;
+        g_arenas = this;
+    }
+#endif
+    tl_arena = this;
+}
+
+FrameArena::~FrameArena() {
+    if (tl_arena == this) tl_arena = nullptr;
+#ifndef NDEBUG
+    {
+        std::lock_guard<std::mutex> lock(g_arenas_mtx);
+        if (prev_) prev_->next_ = next_;
+        else g_arenas = next_;
+        if (next_) next_->prev_ = prev_;
+    }
+#endif
+    std::free(block_);
+}
+
+FrameArena::Region::Region(FrameArena& arena) : prev_(tl_active) {
+    if (tl_arena == &arena) tl_active = true;
+}
+
+FrameArena::Region::~Region() {
+    tl_active = prev_;
+}
+
+void* FrameArena::thread_allocate(std::size_t bytes) {
+    if (!tl_active) return nullptr;
+    FrameArena* a = tl_arena;
+    std::size_t start = (a->used_ + kAlign - 1) & ~(kAlign - 1);
+    if (start + bytes > a->capacity_) {
+        g_overflow.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    a->used_ = start + bytes;
+    return a->block_ + start;
+}
+
+bool FrameArena::thread_release(void* p) noexcept {
+    FrameArena* a = tl_arena;
+    return a && p >= a->block_ && p < a->block_ + a->capacity_;
+}
+
+#ifndef NDEBUG
+bool FrameArena::in_any_arena(const void* p) noexcept {
+    std::lock_guard<std::mutex> lock(g_arenas_mtx);
+    for (FrameArena* a = g_arenas; a; a = a->next_) {
+        if (p >= a->block_ && p < a->block_ + a->capacity_) return true;
+    }
+    return false;
+}
+#endif
+
+FrameArena::Stats FrameArena::stats() {
+    return Stats{g_resets.load(std::memory_order_relaxed),
+                 g_overflow.load(std::memory_order_relaxed),
+                 g_high_water.load(std::memory_order_relaxed)};
+}
+
+void FrameArena::reset() {
+    std::size_t seen = g_high_water.load(std::memory_order_relaxed);
+    while (used_ > seen && !g_high_water.compare_exchange_weak(seen, used_, std::memory_order_relaxed)) {}
+    used_ = 0;
+    g_resets.fetch_add(1, std::memory_order_relaxed);
+}
@@ -0,0 +1,74 @@
+#ifndef FRAMEARENA_H
+#define FRAMEARENA_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Monotonic bump arena for the transient work of one websocket frame
+// (JSON parse, reply tree, dump()). One per connection thread: the block is
+// allocated once, and while a Region is open the replacement operator new in
+// allocstats.cpp serves this thread's allocations from it. Frees of arena
+// memory are no-ops; the whole block is rewound when the Frame ends.
+// Allocations that don't fit fall through to the heap (counted as overflow).
+//
+// Nothing allocated inside a Region may outlive the Frame or leave the
+// thread, so keep Regions around pure parse/serialize code and do
+// SessionManager/Database calls outside them.
+class FrameArena {
+public:
+    explicit FrameArena(std::size_t capacity);
+    ~FrameArena();
+
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    // rewinds the arena when it goes out of scope
+    class Frame {
+    public:
+        explicit Frame(FrameArena& arena) : arena_(arena) {}
+        ~Frame() { arena_.reset(); }
+        Frame(const Frame&) = delete;
+        Frame& operator=(const Frame&) = delete;
+    private:
+        FrameArena& arena_;
+    };
+
+    // routes this thread's operator new into the arena while alive
+    class Region {
+    public:
+        explicit Region(FrameArena& arena);
+        ~Region();
+        Region(const Region&) = delete;
+        Region& operator=(const Region&) = delete;
+    private:
+        bool prev_;
+    };
+
+    // operator new/delete hooks: nullptr / false when the arena isn't involved
+    static void* thread_allocate(std::size_t bytes);
+    static bool thread_release(void* p) noexcept;
+#ifndef NDEBUG
+    // debug builds: whether p lies in any live arena, whichever thread's
+    static bool in_any_arena(const void* p) noexcept;
+#endif
+
+    struct Stats {
+        std::uint64_t resets;
+        std::uint64_t overflow_allocs;
+        std::size_t high_water;     // most bytes any single frame used
+    };
+    static Stats stats();
+
+private:
+    void reset();
+
+    char* block_;
+    std::size_t capacity_;
+    std::size_t used_ = 0;
+#ifndef NDEBUG
+    FrameArena* prev_ = nullptr;
+    FrameArena* next_ = nullptr;
+#endif
+};
+
+#endif
@@ -0,0 +1,518 @@
+// logstore.cpp
+#include "logstore.h"
+
+#include <iostream>
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <filesystem>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr uint32_t kCheckpointMagic = 0x504B434C; // "LCKP"
+constexpr uint32_t kCheckpointVersion = 2;
+constexpr std::size_t kHeaderSize = 8;            // len + crc
+constexpr std::size_t kPayloadFixed = 20;         // ts + three lengths
+constexpr uint64_t kIndexStride = 16;
+constexpr uint64_t kCheckpointEvery = 16384;
+
+std::size_t align8(std::size_t n) {
+    return (n + 7) & ~static_cast<std::size_t>(7);
+}
+
+uint32_t crc32(const char* data, std::size_t n) {
+    static const std::array<uint32_t, 256> table = [] {
+        std::array<uint32_t, 256> t{};
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[i] = c;
+        }
+        return t;
+    }();
+    uint32_t c = 0xFFFFFFFFu;
+    for (std::size_t i = 0; i < n; ++i)
+        c = table[(c ^ static_cast<unsigned char>(data[i])) & 0xFF] ^ (c >> 8);
+    return c ^ 0xFFFFFFFFu;
+}
+
+// fixed-width fields are stored in host order; every target we build for is little endian
+template <typename T>
+T load(const char* p) {
+    T v;
+    std::memcpy(&v, p, sizeof(T));
+    return v;
+}
+
+template <typename T>
+void store(char* p, T v) {
+    std::memcpy(p, &v, sizeof(T));
+}
+
+template <typename T>
+void append(std::string& out, T v) {
+    out.append(reinterpret_cast<const char*>(&v), sizeof(T));
+}
+
+std::string segment_name(uint32_t id) {
+    std::string n = std::to_string(id);
+    return std::string(10 - std::min<std::size_t>(n.size(), 10), '0') + n + ".seg";
+}
+
+} // namespace
+
+LogStore::LogStore(const std::string& dir, std::size_t segment_size)
+    : dir_(dir), segment_size_(segment_size) {}
+
+LogStore::~LogStore() {
+    close();
+}
+
+#ifndef _WIN32
+
+bool LogStore::open() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (open_) return true;
+
+    std::error_code ec;
+    fs::create_directories(dir_, ec);
+    if (ec) {
+        std::cerr << "Failed to create log dir (" << dir_ << "): " << ec.message() << std::endl;
+        return false;
+    }
+
+    // one writer per directory; during a hot restart the successor waits
+    // for the old process to close before it opens the log
+    std::string lock_path = (fs::path(dir_) / "lock").string();
+    lock_fd_ = ::open(lock_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (lock_fd_ < 0 || ::flock(lock_fd_, LOCK_EX | LOCK_NB) != 0) {
+        std::cerr << "Log dir (" << dir_ << ") is in use by another process" << std::endl;
+        if (lock_fd_ >= 0) ::close(lock_fd_);
+        lock_fd_ = -1;
+        return false;
+    }
+
+    std::vector<uint32_t> ids;
+    for (auto const& entry : fs::directory_iterator(dir_, ec)) {
+        if (entry.path().extension() != ".seg") continue;
+        try {
+            ids.push_back(static_cast<uint32_t>(std::stoul(entry.path().stem().string())));
+        } catch (const std::exception&) {
+            std::cerr << "Ignoring stray file in log dir: " << entry.path() << std::endl;
+        }
+    }
+    std::sort(ids.begin(), ids.end());
+
+    bool ok = true;
+    if (ids.empty()) ok = map_segment(0, true);
+    for (uint32_t id : ids) {
+        if (!ok) break;
+        ok = map_segment(id, false);
+    }
+    if (!ok) {
+        unmap_all();
+        ::close(lock_fd_);
+        lock_fd_ = -1;
+        return false;
+    }
+
+    LogPos start;
+    if (!load_checkpoint(start)) {
+        rooms_.clear();
+        start = LogPos{};
+    }
+    recover(start);
+
+    open_ = true;
+    // re-checkpoint right away so the next start skips what we just scanned
+    write_checkpoint();
+    return true;
+}
+
+bool LogStore::close() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (!open_) return true;
+
+    bool ok = write_checkpoint();
+    unmap_all();
+    rooms_.clear();
+    ::close(lock_fd_);
+    lock_fd_ = -1;
+    open_ = false;
+    return ok;
+}
+
+bool LogStore::map_segment(uint32_t id, bool create) {
+    std::string path = (fs::path(dir_) / segment_name(id)).string();
+    int fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC | (create ? O_CREAT : 0), 0644);
+    if (fd < 0) {
+        std::cerr << "Failed to open segment (" << path << "): " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        std::cerr << "fstat failed on segment (" << path << "): " << std::strerror(errno) << std::endl;
+        ::close(fd);
+        return false;
+    }
+    if (static_cast<std::size_t>(st.st_size) > segment_size_) {
+        std::cerr << "Segment " << path << " is larger than the configured segment size" << std::endl;
+        ::close(fd);
+        return false;
+    }
+    if (static_cast<std::size_t>(st.st_size) < segment_size_
+        && ::ftruncate(fd, static_cast<off_t>(segment_size_)) != 0) {
+        std::cerr << "ftruncate failed on segment (" << path << "): " << std::strerror(errno) << std::endl;
+        ::close(fd);
+        return false;
+    }
+
+    void* base = ::mmap(nullptr, segment_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        std::cerr << "mmap failed on segment (" << path << "): " << std::strerror(errno) << std::endl;
+        ::close(fd);
+        return false;
+    }
+
+    Segment seg;
+    seg.id = id;
+    seg.fd = fd;
+    seg.base = static_cast<char*>(base);
+    segments_.push_back(seg);
+    return true;
+}
+
+void LogStore::unmap_all() {
+    for (auto& seg : segments_) {
+        if (seg.base) ::munmap(seg.base, segment_size_);
+        if (seg.fd >= 0) ::close(seg.fd);
+    }
+    segments_.clear();
+    tail_ = LogPos{};
+    checkpoint_pos_ = LogPos{};
+}
+
+bool LogStore::roll_segment() {
+    if (!map_segment(segments_.back().id + 1, true)) return false;
+    tail_.segment = static_cast<uint32_t>(segments_.size() - 1);
+    tail_.offset = 0;
+    return true;
+}
+
+void LogStore::index_record(const std::string& room, LogPos pos) {
+    RoomIndex& ri = rooms_[room];
+    if (ri.count % kIndexStride == 0) ri.sparse.push_back(pos);
+    ++ri.count;
+}
+
+LogStore::RecordState LogStore::check_record(LogPos pos, uint32_t& len) const {
+    if (pos.offset + kHeaderSize > segment_size_) return RecordState::End;
+    const char* rec = segments_[pos.segment].base + pos.offset;
+    len = load<uint32_t>(rec);
+    if (len == 0) return RecordState::End;
+
+    if (len < kPayloadFixed || pos.offset + kHeaderSize + len > segment_size_
+        || crc32(rec + kHeaderSize, len) != load<uint32_t>(rec + 4))
+        return RecordState::Damaged;
+    const char* payload = rec + kHeaderSize;
+    uint64_t body = uint64_t(load<uint32_t>(payload + 8)) + load<uint32_t>(payload + 12) + load<uint32_t>(payload + 16);
+    return body == len - kPayloadFixed ? RecordState::Valid : RecordState::Damaged;
+}
+
+void LogStore::recover(LogPos pos) {
+    uint64_t replayed = 0;
+    for (;;) {
+        Segment& seg = segments_[pos.segment];
+        bool last = pos.segment + 1 == segments_.size();
+
+        uint32_t len = 0;
+        RecordState state = check_record(pos, len);
+        if (state == RecordState::End) {
+            seg.valid_end = pos.offset;
+            if (last) break;
+            pos = LogPos{pos.segment + 1, 0};
+            continue;
+        }
+        if (state == RecordState::Damaged) {
+            std::cerr << "LogStore: bad record in segment " << seg.id << " at offset " << pos.offset
+                      << (last ? ", truncating tail" : ", skipping rest of segment") << std::endl;
+            seg.valid_end = pos.offset;
+            if (last) {
+                // torn append: clear it so the next record lands on zeroes
+                std::memset(seg.base + pos.offset, 0, segment_size_ - pos.offset);
+                break;
+            }
+            pos = LogPos{pos.segment + 1, 0};
+            continue;
+        }
+
+        const char* payload = seg.base + pos.offset + kHeaderSize;
+        index_record(std::string(payload + kPayloadFixed, load<uint32_t>(payload + 8)), pos);
+        pos.offset += static_cast<uint32_t>(align8(kHeaderSize + len));
+        ++replayed;
+    }
+    tail_ = pos;
+    if (replayed) std::cerr << "LogStore: replayed " << replayed << " records past checkpoint" << std::endl;
+}
+
+bool LogStore::load_checkpoint(LogPos& pos) {
+    std::string path = (fs::path(dir_) / "checkpoint").string();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    std::string buf;
+    char chunk[65536];
+    ssize_t n;
+    while ((n = ::read(fd, chunk, sizeof(chunk))) > 0) buf.append(chunk, static_cast<std::size_t>(n));
+    ::close(fd);
+
+    if (buf.size() < 28 || crc32(buf.data(), buf.size() - 4) != load<uint32_t>(buf.data() + buf.size() - 4)) {
+        std::cerr << "LogStore: checkpoint damaged, rescanning whole log" << std::endl;
+        return false;
+    }
+
+    std::unordered_map<uint32_t, uint32_t> by_id;
+    for (std::size_t i = 0; i < segments_.size(); ++i) by_id[segments_[i].id] = static_cast<uint32_t>(i);
+
+    const char* p = buf.data();
+    const char* end = buf.data() + buf.size() - 4;
+    auto need = [&](std::size_t k) { return static_cast<std::size_t>(end - p) >= k; };
+    auto to_pos = [&](uint32_t id, uint32_t off, LogPos& out) {
+        auto it = by_id.find(id);
+        if (it == by_id.end() || off > segment_size_) return false;
+        out = LogPos{it->second, off};
+        return true;
+    };
+
+    if (load<uint32_t>(p) != kCheckpointMagic || load<uint32_t>(p + 4) != kCheckpointVersion) return false;
+    LogPos start;
+    if (!to_pos(load<uint32_t>(p + 8), load<uint32_t>(p + 12), start)) return false;
+    uint32_t nsegs = load<uint32_t>(p + 16);
+    p += 20;
+
+    // valid ends of the segments the checkpoint covers; recover() fills in
+    // the rest from `start` on
+    if (!need(std::size_t(nsegs) * 8 + 4)) return false;
+    std::vector<uint32_t> valid_end(segments_.size(), 0);
+    std::vector<bool> covered(segments_.size(), false);
+    for (uint32_t i = 0; i < nsegs; ++i, p += 8) {
+        LogPos end;
+        if (!to_pos(load<uint32_t>(p), load<uint32_t>(p + 4), end)) return false;
+        valid_end[end.segment] = end.offset;
+        covered[end.segment] = true;
+    }
+    for (uint32_t i = 0; i < start.segment; ++i) {
+        if (!covered[i]) return false;
+    }
+    uint32_t nrooms = load<uint32_t>(p);
+    p += 4;
+
+    std::unordered_map<std::string, RoomIndex> rooms;
+    for (uint32_t r = 0; r < nrooms; ++r) {
+        if (!need(4)) return false;
+        uint32_t name_len = load<uint32_t>(p);
+        p += 4;
+        if (!need(std::size_t(name_len) + 12)) return false;
+        RoomIndex& ri = rooms[std::string(p, name_len)];
+        p += name_len;
+        ri.count = load<uint64_t>(p);
+        uint32_t entries = load<uint32_t>(p + 8);
+        p += 12;
+        if (!need(std::size_t(entries) * 8)) return false;
+        ri.sparse.resize(entries);
+        for (uint32_t e = 0; e < entries; ++e, p += 8) {
+            if (!to_pos(load<uint32_t>(p), load<uint32_t>(p + 4), ri.sparse[e])) return false;
+        }
+    }
+
+    rooms_ = std::move(rooms);
+    for (std::size_t i = 0; i < segments_.size(); ++i) segments_[i].valid_end = valid_end[i];
+    pos = start;
+    return true;
+}
+
+bool LogStore::write_checkpoint() {
+    // make everything up to tail_ durable before the checkpoint claims it
+    for (std::size_t i = checkpoint_pos_.segment; i <= tail_.segment && i < segments_.size(); ++i) {
+        if (::msync(segments_[i].base, segment_size_, MS_SYNC) != 0) {
+            std::cerr << "msync failed: " << std::strerror(errno) << std::endl;
+            return false;
+        }
+    }
+
+    std::string buf;
+    append<uint32_t>(buf, kCheckpointMagic);
+    append<uint32_t>(buf, kCheckpointVersion);
+    append<uint32_t>(buf, segments_[tail_.segment].id);
+    append<uint32_t>(buf, tail_.offset);
+    append<uint32_t>(buf, tail_.segment + 1);
+    for (uint32_t i = 0; i <= tail_.segment; ++i) {
+        append<uint32_t>(buf, segments_[i].id);
+        append<uint32_t>(buf, segments_[i].valid_end);
+    }
+    append<uint32_t>(buf, static_cast<uint32_t>(rooms_.size()));
+    for (auto const& kv : rooms_) {
+        append<uint32_t>(buf, static_cast<uint32_t>(kv.first.size()));
+        buf += kv.first;
+        append<uint64_t>(buf, kv.second.count);
+        append<uint32_t>(buf, static_cast<uint32_t>(kv.second.sparse.size()));
+        for (auto const& lp : kv.second.sparse) {
+            append<uint32_t>(buf, segments_[lp.segment].id);
+            append<uint32_t>(buf, lp.offset);
+        }
+    }
+    append<uint32_t>(buf, crc32(buf.data(), buf.size()));
+
+    std::string path = (fs::path(dir_) / "checkpoint").string();
+    std::string tmp = path + ".tmp";
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        std::cerr << "Failed to write checkpoint: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    std::size_t done = 0;
+    while (done < buf.size()) {
+        ssize_t n = ::write(fd, buf.data() + done, buf.size() - done);
+        if (n <= 0) {
+            std::cerr << "Failed to write checkpoint: " << std::strerror(errno) << std::endl;
+            ::close(fd);
+            return false;
+        }
+        done += static_cast<std::size_t>(n);
+    }
+    ::fsync(fd);
+    ::close(fd);
+
+    std::error_code ec;
+    fs::rename(tmp, path, ec);
+    if (ec) {
+        std::cerr << "Failed to publish checkpoint: " << ec.message() << std::endl;
+        return false;
+    }
+    checkpoint_pos_ = tail_;
+    since_checkpoint_ = 0;
+    return true;
+}
+
+void LogStore::insert_message(const std::string& room,
+                              const std::string& username,
+                              const std::string& text,
+                              long long ts) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (!open_) {
+        std::cerr << "Log not open in insert_message\n";
+        return;
+    }
+
+    std::size_t len = kPayloadFixed + room.size() + username.size() + text.size();
+    std::size_t total = align8(kHeaderSize + len);
+    if (total > segment_size_) {
+        std::cerr << "insert_message: record of " << len << " bytes does not fit a segment\n";
+        return;
+    }
+    if (tail_.offset + total > segment_size_ && !roll_segment()) return;
+
+    char* rec = segments_[tail_.segment].base + tail_.offset;
+    char* payload = rec + kHeaderSize;
+    store<int64_t>(payload, static_cast<int64_t>(ts));
+    store<uint32_t>(payload + 8, static_cast<uint32_t>(room.size()));
+    store<uint32_t>(payload + 12, static_cast<uint32_t>(username.size()));
+    store<uint32_t>(payload + 16, static_cast<uint32_t>(text.size()));
+    char* body = payload + kPayloadFixed;
+    std::memcpy(body, room.data(), room.size());
+    std::memcpy(body + room.size(), username.data(), username.size());
+    std::memcpy(body + room.size() + username.size(), text.data(), text.size());
+
+    // header last: until len is non-zero the record does not exist
+    store<uint32_t>(rec + 4, crc32(payload, len));
+    store<uint32_t>(rec, static_cast<uint32_t>(len));
+
+    index_record(room, tail_);
+    tail_.offset += static_cast<uint32_t>(total);
+    segments_[tail_.segment].valid_end = tail_.offset;
+
+    if (++since_checkpoint_ >= kCheckpointEvery) write_checkpoint();
+}
+
+std::vector<ChatMessage> LogStore::get_recent_messages(const std::string &room, int limit) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    std::vector<ChatMessage> out;
+    if (!open_ || limit <= 0) return out;
+
+    auto it = rooms_.find(room);
+    if (it == rooms_.end() || it->second.count == 0) return out;
+    const RoomIndex& ri = it->second;
+
+    uint64_t want = std::min<uint64_t>(static_cast<uint64_t>(limit), ri.count);
+    uint64_t first = ri.count - want;
+    std::size_t entry = static_cast<std::size_t>(first / kIndexStride);
+    uint64_t skip = first - entry * kIndexStride;
+    LogPos pos = ri.sparse[entry];
+    out.reserve(static_cast<std::size_t>(want));
+
+    // sequential replay from the nearest index entry; other rooms' records
+    // are skipped after a length compare on the room name. Only records
+    // below valid_end are visited, so these are exactly the ones recover()
+    // and append counted in the index and need no second CRC.
+    while (out.size() < want && pos.segment < segments_.size()) {
+        const Segment& seg = segments_[pos.segment];
+        if (pos.offset >= seg.valid_end) {
+            pos = LogPos{pos.segment + 1, 0};
+            continue;
+        }
+
+        const char* rec = seg.base + pos.offset;
+        uint32_t len = load<uint32_t>(rec);
+        const char* payload = rec + kHeaderSize;
+        uint32_t room_len = load<uint32_t>(payload + 8);
+        const char* body = payload + kPayloadFixed;
+        if (room_len == room.size() && std::memcmp(body, room.data(), room_len) == 0) {
+            if (skip > 0) {
+                --skip;
+            } else {
+                uint32_t user_len = load<uint32_t>(payload + 12);
+                uint32_t text_len = load<uint32_t>(payload + 16);
+                ChatMessage m;
+                m.username.assign(body + room_len, user_len);
+                m.text.assign(body + room_len + user_len, text_len);
+                m.ts = static_cast<long long>(load<int64_t>(payload));
+                m.room = room;
+                out.push_back(std::move(m));
+            }
+        }
+        pos.offset += static_cast<uint32_t>(align8(kHeaderSize + len));
+    }
+    return out;
+}
+
+#else // _WIN32
+
+bool LogStore::open() {
+    std::cerr << "The log storage backend needs mmap and is not available on Windows" << std::endl;
+    return false;
+}
+
+bool LogStore::close() {
+    return true;
+}
+
+std::vector<ChatMessage> LogStore::get_recent_messages(const std::string &, int) {
+    return {};
+}
+
+void LogStore::insert_message(const std::string&, const std::string&, const std::string&, long long) {
+    std::cerr << "Log not open in insert_message\n";
+}
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef LOGSTORE_H
+#define LOGSTORE_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <cstdint>
+#include <cstddef>
+#include <unordered_map>
+
+#include "database.h"
+
+// Append-only message log. `path` is a directory holding fixed-size segment
+// files (<id>.seg) that are mmap'd and filled front to back, plus a
+// `checkpoint` file with the per-room index and the log position it covers.
+//
+// Record layout (little endian, 8-byte aligned):
+//   u32 len | u32 crc32(payload) | i64 ts | u32 room_len | u32 user_len | u32 text_len | room | user | text
+// A zero `len` marks the end of the written part of a segment. The payload is
+// copied before the header, so a torn append leaves either len == 0 or a CRC
+// mismatch, and recovery stops there.
+//
+// At open() the checkpoint is loaded and only the records after it are
+// rescanned; a missing or damaged checkpoint just means scanning everything.
+// Records are CRC-checked only there and written by append, so each segment
+// keeps the end of its valid records and history reads step by length alone.
+// An flock on <dir>/lock keeps a second process from opening the same log.
+// POSIX only (mmap); on Windows open() fails and SQLite should be used.
+class LogStore : public MessageStore {
+public:
+    static constexpr std::size_t kDefaultSegmentSize = 64u * 1024 * 1024;
+
+    LogStore(const std::string& dir, std::size_t segment_size = kDefaultSegmentSize);
+    ~LogStore() override;
+
+    LogStore(const LogStore&) = delete;
+    LogStore& operator=(const LogStore&) = delete;
+
+    bool open() override;
+    bool close() override;
+    std::vector<ChatMessage> get_recent_messages(const std::string &room, int limit) override;
+    void insert_message(const std::string& room, const std::string& username, const std::string& text, long long ts) override;
+
+private:
+    struct Segment {
+        uint32_t id = 0;
+        int fd = -1;
+        char* base = nullptr;
+        uint32_t valid_end = 0;   // records before this offset passed recovery or were appended
+    };
+
+    struct LogPos {
+        uint32_t segment = 0;   // index into segments_, not the file id
+        uint32_t offset = 0;
+    };
+
+    // Sparse index: every kIndexStride-th message of a room gets a LogPos, so
+    // a history read seeks to the nearest entry and replays forward from it.
+    struct RoomIndex {
+        uint64_t count = 0;
+        std::vector<LogPos> sparse;
+    };
+
+    enum class RecordState { Valid, End, Damaged };
+
+    bool map_segment(uint32_t id, bool create);
+    void unmap_all();
+    bool roll_segment();
+    void index_record(const std::string& room, LogPos pos);
+    // bounds, CRC and field lengths of the record at pos; End covers both a
+    // zero len and too little room left in the segment for a header
+    RecordState check_record(LogPos pos, uint32_t& len) const;
+    void recover(LogPos from);
+    bool load_checkpoint(LogPos& pos);
+    bool write_checkpoint();
+
+    std::string dir_;
+    std::size_t segment_size_;
+    std::vector<Segment> segments_;
+    LogPos tail_;                    // next append position
+    LogPos checkpoint_pos_;
+    std::unordered_map<std::string, RoomIndex> rooms_;
+    uint64_t since_checkpoint_ = 0;
+    int lock_fd_ = -1;
+    bool open_ = false;
+    std::mutex mtx_;
+};
+
+#endif
@@ -5,6 +5,27 @@
 #include <thread>
 #include <filesystem>
 #include <chrono>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <cerrno>
+#include <cstring>
+#include <csignal>
+#include <atomic>
+#include <string_view>
+#include <optional>
+#include <unordered_set>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+extern char** environ;
+#endif
 
 #include <boost/beast/core.hpp>
 #include <boost/beast/http.hpp>
@@ -16,6 +37,9 @@
 
 #include "sessionmanager.h"
 #include "database.h" // your Database header
+#include "bufferpool.h"
+#include "framearena.h"
+#include "allocstats.h"
 
 namespace beast = boost::beast;
 namespace http  = beast::http;
@@ -25,7 +49,7 @@ using tcp = net::ip::tcp;
 using json = nlohmann::json;
 namespace fs = std::filesystem;
 
-using ws_ptr = std::shared_ptr<websocket::stream<tcp::socket>>;
+using ws_ptr = std::shared_ptr<websocket::stream<SessionStream>>;
 
 // Helper to get epoch ms
 inline long long now_ms() {
@@ -125,8 +149,64 @@ static bool serve_static_or_fallback(beast::tcp_stream &stream,
     }
 }
 
+// arena bytes per byte of max message: parse, reply tree and dump() all
+// hold a copy of the text at the same time
+static constexpr std::size_t kArenaPerMessage = 4;
+static constexpr std::size_t kDefaultMaxMessage = 16 * 1024;
+// idle read buffers kept for reuse by later connections
+static constexpr std::size_t kPooledReadBuffers = 1024;
+
+// Parsed request tree, built in the arena. nlohmann's destructor allocates a
+// scratch stack for objects/arrays, so it is torn down inside a Region too.
+struct FrameJson {
+    FrameArena& arena;
+    json value;
+    ~FrameJson() {
+        FrameArena::Region teardown(arena);
+        value = nullptr;
+    }
+};
+
+static std::atomic<std::uint64_t> g_frames{0};
+static std::atomic<std::uint64_t> g_frame_allocs{0};
+
+// heap allocations made on this thread while one frame was handled
+struct FrameTally {
+    std::uint64_t start = alloc_stats::thread_allocs();
+    ~FrameTally() {
+        g_frames.fetch_add(1, std::memory_order_relaxed);
+        g_frame_allocs.fetch_add(alloc_stats::thread_allocs() - start, std::memory_order_relaxed);
+    }
+};
 
-void handle_connection(tcp::socket socket, SessionManager& manager, Database& db) {
+// GET /stats: allocator and buffer counters, for checking that steady-state
+// frames stay off the heap
+static void serve_stats(beast::tcp_stream &stream,
+                        const http::request<http::string_body>& req,
+                        BufferPool& buffers)
+{
+    auto arena = FrameArena::stats();
+    auto pool = buffers.stats();
+    json body = {
+        {"heap", {{"allocs", alloc_stats::allocs()}, {"frees", alloc_stats::frees()}}},
+        {"frames", {{"count", g_frames.load()}, {"heap_allocs", g_frame_allocs.load()}}},
+        {"arena", {{"resets", arena.resets}, {"overflow_allocs", arena.overflow_allocs},
+                   {"high_water", arena.high_water}}},
+        {"read_buffers", {{"created", pool.created}, {"reused", pool.reused}, {"pooled", pool.pooled},
+                          {"max_message", buffers.max_message()}}}
+    };
+    http::response<http::string_body> res{http::status::ok, req.version()};
+    res.set(http::field::content_type, "application/json");
+    res.body() = body.dump();
+    res.prepare_payload();
+    beast::error_code ec;
+    http::write(stream.socket(), res, ec);
+}
+
+void handle_connection(tcp::socket socket, SessionManager& manager, Database& db, BufferPool& buffers) {
+    ws_ptr ws;
+    // outlives the try so exceptions thrown inside a Region are still valid in the handlers
+    std::optional<FrameArena> arena;
     try {
         beast::flat_buffer buffer;
         beast::tcp_stream stream(std::move(socket));
@@ -142,39 +222,57 @@ void handle_connection(tcp::socket socket, SessionManager& manager, Database& db
         }
 
         if (!websocket::is_upgrade(req)) {
+            if (req.target() == "/stats") {
+                serve_stats(stream, req, buffers);
+                return;
+            }
             serve_static_or_fallback(stream, req, "/app/static", true);
             return;
         }
 
         // Create websocket from underlying socket and accept handshake
-        auto ws = std::make_shared<websocket::stream<tcp::socket>>(stream.release_socket());
+        ws = std::make_shared<websocket::stream<SessionStream>>(stream.release_socket());
         ws->accept(req);
+        // already draining: don't start a session that close_all has missed
+        if (!manager.attach(ws)) return;
+
+        // frames larger than this fail the read (1009 close) instead of growing buffers
+        ws->read_message_max(buffers.max_message());
 
         // per-connection state
         std::string username;
         std::string room = "lobby";
+        std::string text;   // reused across frames so db inserts don't allocate
+        arena.emplace(kArenaPerMessage * buffers.max_message());
 
         // message loop
-        beast::flat_buffer read_buf;
+        BufferPool::Handle read_buf = buffers.acquire();
         for (;;) {
-            ws->read(read_buf);
+            read_buf->consume(read_buf->size());
+            ws->read(*read_buf);
+
+            // parse/serialize below runs in FrameArena::Regions; the arena is
+            // rewound when `frame` goes out of scope
+            FrameTally tally;
+            FrameArena::Frame frame(*arena);
 
             // ignore non-text frames
             if (!ws->got_text()) {
                 std::cerr << "Received non-text (binary/ping) frame — ignoring\n";
-                read_buf.consume(read_buf.size());
                 continue;
             }
 
             // raw payload logging
-            std::string raw = beast::buffers_to_string(read_buf.data());
-            read_buf.consume(read_buf.size());
+            auto data = read_buf->data();
+            std::string_view raw(static_cast<const char*>(data.data()), data.size());
             std::cerr << "[RAW MSG] ws=" << ws.get() << " -> " << raw << "\n";
 
             // parse safely
-            json j;
+            FrameJson request{*arena, json()};
+            json& j = request.value;
             try {
-                j = json::parse(raw);
+                FrameArena::Region parse(*arena);
+                j = json::parse(raw.begin(), raw.end());
             } catch (const std::exception& e) {
                 std::cerr << "Invalid JSON (ignored): " << e.what() << " >> " << raw << "\n";
                 continue;
@@ -190,7 +288,10 @@ void handle_connection(tcp::socket socket, SessionManager& manager, Database& db
                 std::cerr << "Missing/invalid 'type' (ignored): " << j.dump() << "\n";
                 continue;
             }
-            std::string type = it->get<std::string>();
+            std::string_view type = it->get_ref<const std::string&>();
+            auto field = [&j](const char* key) -> std::string_view {
+                return j[key].get_ref<const std::string&>();
+            };
 
             if (type == "join") {
                 if (!j.contains("username") || !j["username"].is_string()
@@ -198,34 +299,40 @@ void handle_connection(tcp::socket socket, SessionManager& manager, Database& db
                     std::cerr << "'join' missing fields: " << j.dump() << "\n";
                     continue;
                 }
-                username = j["username"].get<std::string>();
-                room = j["room"].get<std::string>();
+                username = field("username");
+                room = field("room");
 
                 // register the session *now* with username+room
                 manager.add(ws, username, room);
 
                 // send joined + recent
                 auto recent = db.get_recent_messages(room, 50);
-                json recent_json = json::array();
-                for (auto &m : recent) {
-                    recent_json.push_back({
-                        {"username", m.username},
-                        {"text", m.text},
-                        {"ts", m.ts}
-                    });
+                auto users = manager.list_users(room);
+                std::string joined_s, pres_s;
+                {
+                    FrameArena::Region serialize(*arena);
+                    json recent_json = json::array();
+                    for (auto &m : recent) {
+                        recent_json.push_back({
+                            {"username", m.username},
+                            {"text", m.text},
+                            {"ts", m.ts}
+                        });
+                    }
+                    json joined = {
+                        {"type", "joined"},
+                        {"username", username},
+                        {"room", room},
+                        {"recent", recent_json}
+                    };
+                    joined_s = joined.dump();
+                    json pres = { {"type","presence"}, {"users", users} };
+                    pres_s = pres.dump();
                 }
-                json joined = {
-                    {"type", "joined"},
-                    {"username", username},
-                    {"room", room},
-                    {"recent", recent_json}
-                };
-                ws->text(true);
-                ws->write(net::buffer(joined.dump()));
+                manager.send(ws, joined_s);
 
                 // broadcast presence (dump into string for manager)
-                json pres = { {"type","presence"}, {"users", manager.list_users(room)} };
-                manager.broadcast(room, pres.dump(), ws);
+                manager.broadcast(room, pres_s, ws);
 
             } else if (type == "message") {
                 if (!j.contains("text") || !j["text"].is_string()) {
@@ -236,18 +343,23 @@ void handle_connection(tcp::socket socket, SessionManager& manager, Database& db
                     std::cerr << "Client sent 'message' before join: " << j.dump() << "\n";
                     continue;
                 }
-                std::string text = j["text"].get<std::string>();
+                text = field("text");
                 long long ts = now_ms();
                 db.insert_message(room, username, text, ts);
 
-                json out = {
-                    {"type", "message"},
-                    {"username", username},
-                    {"room", room},
-                    {"text", text},
-                    {"ts", ts}
-                };
-                manager.broadcast(room, out.dump(), ws);
+                std::string out_s;
+                {
+                    FrameArena::Region serialize(*arena);
+                    json out = {
+                        {"type", "message"},
+                        {"username", username},
+                        {"room", room},
+                        {"text", text},
+                        {"ts", ts}
+                    };
+                    out_s = out.dump();
+                }
+                manager.broadcast(room, out_s, ws);
 
             } else if (type == "private") {
                 if (!j.contains("to") || !j["to"].is_string()
@@ -259,61 +371,505 @@ void handle_connection(tcp::socket socket, SessionManager& manager, Database& db
                     std::cerr << "Client sent 'private' before join: " << j.dump() << "\n";
                     continue;
                 }
-                std::string to = j["to"].get<std::string>();
-                std::string text = j["text"].get<std::string>();
-                json out = {
-                    {"type", "private"},
-                    {"username", username},
-                    {"text", text},
-                    {"ts", now_ms()}
-                };
-                manager.send_to_user(to, out.dump());
-                manager.send_to_user(username, out.dump());
+                std::string to(field("to"));
+                std::string out_s;
+                {
+                    FrameArena::Region serialize(*arena);
+                    json out = {
+                        {"type", "private"},
+                        {"username", username},
+                        {"text", j["text"]},
+                        {"ts", now_ms()}
+                    };
+                    out_s = out.dump();
+                }
+                manager.send_to_user(to, out_s);
+                manager.send_to_user(username, out_s);
 
             } else if (type == "list") {
-                json out = { {"type","list"}, {"users", manager.list_users(room)} };
-                ws->text(true);
-                ws->write(net::buffer(out.dump()));
+                auto users = manager.list_users(room);
+                std::string out_s;
+                {
+                    FrameArena::Region serialize(*arena);
+                    json out = { {"type","list"}, {"users", users} };
+                    out_s = out.dump();
+                }
+                manager.send(ws, out_s);
             } else {
                 std::cerr << "Unknown type (ignored): " << type << " -> " << j.dump() << "\n";
             }
         } // for(;;)
 
-        // unreachable here, manager.remove could be placed in exception handling
+        // unreachable here, the loop only ends by throwing
     } catch (beast::system_error const& se) {
         std::cerr << "Beast error: " << se.what() << "\n";
     } catch (std::exception const& e) {
         std::cerr << "Conn exception: " << e.what() << "\n";
     }
+    if (ws) manager.remove(ws);
+}
+
+
+
+// ---- shutdown / hot restart ----
+// SIGINT/SIGTERM: stop accepting, close every websocket with a retry-after
+// hint, wait for the connection threads, close (and so flush) the DB, exit.
+// SIGUSR2: same drain, but first exec a fresh copy of this binary that
+// inherits the listening socket (LISTEN_FD) and a pipe (RESTART_READY_FD).
+// The successor accepts right away. Only its storage waits: SQLite (WAL) can
+// be opened alongside us, while the single-writer log is opened once the pipe
+// reports that we have closed it; DB calls made meanwhile block in Database.
+
+static constexpr int kReconnectSpreadMs = 5000;
+static constexpr auto kDrainTimeout = std::chrono::seconds(5);
+
+// detached connection threads check in/out here so main() can wait for them
+struct ActiveConnections {
+    std::mutex mtx;
+    std::condition_variable cv;
+    int count = 0;
+    // a dup of every connection's socket, closed in leave(), so stop_reading()
+    // can never hit a descriptor number that has since been reused
+    std::unordered_set<int> fds;
+
+    // returns the token to hand back to leave()
+    int enter(tcp::socket& socket) {
+        std::lock_guard<std::mutex> lock(mtx);
+        ++count;
+        int fd = -1;
+#ifndef _WIN32
+        fd = ::fcntl(socket.native_handle(), F_DUPFD_CLOEXEC, 0);
+        if (fd >= 0) fds.insert(fd);
+#else
+        (void)socket;
+#endif
+        return fd;
+    }
+    void leave(int fd) {
+        // notify under the lock: once wait_idle sees 0, main may destroy us
+        std::lock_guard<std::mutex> lock(mtx);
+        --count;
+#ifndef _WIN32
+        if (fd >= 0 && fds.erase(fd)) ::close(fd);
+#endif
+        cv.notify_all();
+    }
+    // Connections still reading an HTTP request see EOF and finish; responses
+    // being written still go out.
+    void stop_reading() {
+        std::lock_guard<std::mutex> lock(mtx);
+#ifndef _WIN32
+        for (int fd : fds) ::shutdown(fd, SHUT_RD);
+#endif
+    }
+    bool wait_idle(std::chrono::steady_clock::duration timeout) {
+        std::unique_lock<std::mutex> lock(mtx);
+        return cv.wait_for(lock, timeout, [this] { return count == 0; });
+    }
+};
+
+static int env_fd(const char* name) {
+    const char* v = std::getenv(name);
+    return v ? std::atoi(v) : -1;
+}
+
+static unsigned short listen_port() {
+    const char* p = std::getenv("PORT");
+    return static_cast<unsigned short>(p ? std::atoi(p) : 8080);
 }
 
+#ifndef _WIN32
+// What a hot restart execs, fixed at startup. Not /proc/self/exe: that is
+// the running inode, i.e. the old binary once a deploy has renamed a new one
+// into place. The path itself (symlinks left unresolved, so a swapped
+// release link is followed too) names whatever is installed now.
+// SERVER_BINARY overrides it; empty when argv[0] can't be located.
+static std::string executable_path(const char* argv0) {
+    if (const char* e = std::getenv("SERVER_BINARY")) return e;
+    std::string name = argv0 ? argv0 : "";
+    if (name.empty()) return {};
+    if (name.find('/') == std::string::npos) {
+        // started through PATH lookup
+        const char* path = std::getenv("PATH");
+        std::string dirs = path ? path : "";
+        std::size_t begin = 0;
+        std::string found;
+        while (found.empty() && begin <= dirs.size()) {
+            std::size_t end = dirs.find(':', begin);
+            if (end == std::string::npos) end = dirs.size();
+            std::string dir = dirs.substr(begin, end - begin);
+            std::string candidate = (dir.empty() ? std::string(".") : dir) + "/" + name;
+            if (::access(candidate.c_str(), X_OK) == 0) found = candidate;
+            begin = end + 1;
+        }
+        if (found.empty()) return {};
+        name = found;
+    }
+    std::error_code ec;
+    fs::path abs = fs::absolute(name, ec);
+    return ec ? std::string() : abs.lexically_normal().string();
+}
+
+// fork + exec `exe`, handing it each fd in `pass` (inherited, and exported
+// as NAME=fd). Returns the child's pid once the exec went through, or -1.
+static pid_t spawn_process(const std::string& exe, char** argv,
+                           const std::vector<std::pair<std::string, int>>& pass) {
+    int status[2];   // CLOEXEC: EOF means exec worked, otherwise carries errno
+    if (::pipe(status) != 0 || ::fcntl(status[1], F_SETFD, FD_CLOEXEC) != 0) {
+        std::cerr << "pipe failed: " << std::strerror(errno) << "\n";
+        return -1;
+    }
+
+    // only async-signal-safe calls are allowed after fork, so build the
+    // environment up front
+    std::vector<std::string> env;
+    for (char** e = environ; *e; ++e) {
+        std::string kv(*e);
+        bool replaced = false;
+        for (auto const& p : pass) replaced = replaced || kv.rfind(p.first + "=", 0) == 0;
+        if (!replaced) env.push_back(std::move(kv));
+    }
+    for (auto const& p : pass) env.push_back(p.first + "=" + std::to_string(p.second));
+    std::vector<char*> envp;
+    for (auto& kv : env) envp.push_back(&kv[0]);
+    envp.push_back(nullptr);
+    long max_fd = ::sysconf(_SC_OPEN_MAX);
+    if (max_fd < 0) max_fd = 1024;
+
+    pid_t pid = ::fork();
+    if (pid < 0) {
+        std::cerr << "fork failed: " << std::strerror(errno) << "\n";
+        ::close(status[0]);
+        ::close(status[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        // drop client sockets, DB files etc.; keep stdio, the passed fds and the status pipe
+        for (int fd = 3; fd < max_fd; ++fd) {
+            bool keep = fd == status[1];
+            for (auto const& p : pass) keep = keep || fd == p.second;
+            if (!keep) ::close(fd);
+        }
+        for (auto const& p : pass) ::fcntl(p.second, F_SETFD, 0);
+        ::execve(exe.c_str(), argv, envp.data());
+        int err = errno;
+        ssize_t ignored = ::write(status[1], &err, sizeof(err));
+        (void)ignored;
+        ::_exit(127);
+    }
+
+    ::close(status[1]);
+    int err = 0;
+    ssize_t n;
+    while ((n = ::read(status[0], &err, sizeof(err))) < 0 && errno == EINTR) {}
+    ::close(status[0]);
+    if (n > 0) {
+        std::cerr << "exec of " << exe << " failed: " << std::strerror(err) << "\n";
+        ::waitpid(pid, nullptr, 0);
+        return -1;
+    }
+    return pid;
+}
+
+// fork + exec `exe` with the listener inherited. Returns the write end
+// of the ready pipe, or -1 if the new process could not be started.
+// Under --supervise the successor's pid is also reported to the supervisor.
+static int spawn_successor(const std::string& exe, char** argv, int listen_fd) {
+    int ready[2];
+    if (::pipe(ready) != 0) {
+        std::cerr << "pipe failed: " << std::strerror(errno) << "\n";
+        return -1;
+    }
+    std::vector<std::pair<std::string, int>> pass{{"LISTEN_FD", listen_fd}, {"RESTART_READY_FD", ready[0]}};
+    int supervisor_fd = env_fd("SUPERVISOR_FD");
+    if (supervisor_fd >= 0) pass.emplace_back("SUPERVISOR_FD", supervisor_fd);
+
+    pid_t pid = spawn_process(exe, argv, pass);
+    ::close(ready[0]);
+    if (pid < 0) {
+        ::close(ready[1]);
+        return -1;
+    }
+    std::cerr << "Started successor pid " << pid << "\n";
+    if (supervisor_fd >= 0) {
+        std::int32_t v = static_cast<std::int32_t>(pid);
+        if (::write(supervisor_fd, &v, sizeof(v)) != static_cast<ssize_t>(sizeof(v)))
+            std::cerr << "Could not report successor to supervisor: " << std::strerror(errno) << "\n";
+    }
+    return ready[1];
+}
 
-int main() {
+// successor side: returns once the previous process has drained and let go of the DB
+static void wait_for_predecessor(int ready_fd) {
+    char c;
+    for (;;) {
+        ssize_t n = ::read(ready_fd, &c, 1);
+        if (n > 0 || (n < 0 && errno == EINTR)) continue;
+        break;
+    }
+    ::close(ready_fd);
+}
+
+#ifdef __linux__
+// --supervise: a parent that owns the listener and outlives its workers, so
+// a hot restart works where the server would otherwise be PID 1 (as in our
+// container, where the old process exiting stops everything). Workers are
+// this binary without the flag. SIGUSR2 goes to the current worker, which
+// hot-restarts as usual and reports its successor's pid on SUPERVISOR_FD;
+// as child subreaper we inherit the successor when the old worker exits.
+// SIGINT/SIGTERM go to every worker, and we exit once none is left.
+static int supervise(const std::string& exe, char** argv) {
+    if (exe.empty()) {
+        std::cerr << "Can't locate the server binary; set SERVER_BINARY\n";
+        return 1;
+    }
+    std::vector<char*> worker_argv;
+    for (char** a = argv; *a; ++a) {
+        if (std::strcmp(*a, "--supervise") != 0) worker_argv.push_back(*a);
+    }
+    worker_argv.push_back(nullptr);
+
+    if (::prctl(PR_SET_CHILD_SUBREAPER, 1) != 0) {
+        std::cerr << "prctl(PR_SET_CHILD_SUBREAPER) failed: " << std::strerror(errno) << "\n";
+        return 1;
+    }
+    int report[2];
+    if (::pipe2(report, O_CLOEXEC) != 0) {
+        std::cerr << "pipe failed: " << std::strerror(errno) << "\n";
+        return 1;
+    }
+
+    net::io_context ioc{1};
+    unsigned short port = listen_port();
+    tcp::acceptor acceptor(ioc, {tcp::v4(), port});
+    std::cout << "Supervisor listening on port " << port << "\n";
+
+    // registered before the first fork so no SIGCHLD is missed
+    net::signal_set signals(ioc, SIGINT, SIGTERM, SIGUSR2);
+    signals.add(SIGCHLD);
+
+    pid_t current = spawn_process(exe, worker_argv.data(),
+                                  {{"LISTEN_FD", acceptor.native_handle()}, {"SUPERVISOR_FD", report[1]}});
+    ::close(report[1]);
+    if (current < 0) {
+        ::close(report[0]);
+        return 1;
+    }
+    std::cerr << "Started worker pid " << current << "\n";
+
+    std::unordered_set<pid_t> workers{current};
+    std::unordered_set<pid_t> reaped_unknown;   // successors that died before their report was read
+    bool stopping = false;
+    int exit_code = 0;
+
+    auto stop_all = [&](int sig) {
+        stopping = true;
+        beast::error_code ignored;
+        acceptor.close(ignored);
+        for (pid_t w : workers) ::kill(w, sig);
+    };
+
+    net::posix::stream_descriptor reports(ioc, report[0]);
+    std::int32_t reported = 0;
+    std::function<void()> read_report = [&] {
+        net::async_read(reports, net::buffer(&reported, sizeof(reported)),
+                        [&](beast::error_code ec, std::size_t) {
+            if (ec) return;
+            pid_t pid = static_cast<pid_t>(reported);
+            current = pid;
+            if (reaped_unknown.erase(pid) == 0) {
+                workers.insert(pid);
+                if (stopping) ::kill(pid, SIGTERM);
+            } else if (!stopping) {
+                std::cerr << "Successor " << pid << " exited before taking over\n";
+                exit_code = 1;
+                stop_all(SIGTERM);
+            }
+            if (workers.empty()) ioc.stop();
+            read_report();
+        });
+    };
+
+    std::function<void(beast::error_code, int)> on_signal = [&](beast::error_code ec, int sig) {
+        if (ec) return;
+        if (sig == SIGUSR2) {
+            if (!stopping) ::kill(current, SIGUSR2);
+        } else if (sig == SIGCHLD) {
+            int status = 0;
+            pid_t pid;
+            while ((pid = ::waitpid(-1, &status, WNOHANG)) > 0) {
+                if (workers.erase(pid) == 0) {
+                    reaped_unknown.insert(pid);
+                    continue;
+                }
+                if (pid != current) continue;   // a predecessor done draining
+                exit_code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+                if (!stopping) {
+                    std::cerr << "Worker " << pid << " exited (" << exit_code << ") without a successor\n";
+                    if (exit_code == 0) exit_code = 1;
+                    stop_all(SIGTERM);
+                }
+            }
+        } else {
+            std::cerr << "Signal " << sig << ": stopping workers\n";
+            stop_all(sig);
+        }
+        if (workers.empty()) {
+            ioc.stop();
+            return;
+        }
+        signals.async_wait(on_signal);
+    };
+    signals.async_wait(on_signal);
+    read_report();
+
+    ioc.run();
+    std::cerr << "Supervisor exiting\n";
+    return exit_code;
+}
+#endif
+#endif
+
+int main(int argc, char** argv) {
+    (void)argc;
+    // before anything opens SQLite, so /stats heap counts include it
+    alloc_stats::count_sqlite();
+#ifndef _WIN32
+    // resolved before anything could chdir
+    const std::string self_exe = executable_path(argc > 0 ? argv[0] : nullptr);
+#endif
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--supervise") != 0) continue;
+#ifdef __linux__
+        return supervise(self_exe, argv);
+#else
+        std::cerr << "--supervise is only supported on Linux\n";
+        return 1;
+#endif
+    }
     try {
         net::io_context ioc{1};
         SessionManager manager;
-        Database db("messages.db");
-        if (!db.open()) {
-            std::cerr << "DB open failed\n";
-            return 1;
+        ActiveConnections active;
+        std::atomic<bool> storage_failed{false};
+
+        tcp::acceptor acceptor(ioc);
+        int inherited_fd = env_fd("LISTEN_FD");
+        if (inherited_fd >= 0) {
+            acceptor.assign(tcp::v4(), inherited_fd);
+            std::cout << "Inherited listener on port " << acceptor.local_endpoint().port() << "\n";
+        } else {
+            unsigned short port = listen_port();
+            acceptor = tcp::acceptor(ioc, {tcp::v4(), port});
+            std::cout << "Listening on port " << port << "\n";
         }
 
-        int port = [] {
-            const char* p = std::getenv("PORT");
-            return p ? std::atoi(p) : 8080;
+        // STORAGE_BACKEND=log switches to the append-only log (see logstore.h)
+        StorageBackend backend = StorageBackend::Sqlite;
+        if (const char* b = std::getenv("STORAGE_BACKEND")) {
+            if (!parse_storage_backend(b, backend)) {
+                std::cerr << "Unknown STORAGE_BACKEND '" << b << "' (expected sqlite or log)\n";
+                return 1;
+            }
+        }
+        Database db(backend == StorageBackend::Log ? "messages.log" : "messages.db", backend);
+
+        // MAX_MESSAGE_BYTES caps a single websocket message (and so the read
+        // buffers and per-connection arena sized from it)
+        std::size_t max_message = [] {
+            const char* m = std::getenv("MAX_MESSAGE_BYTES");
+            long long v = m ? std::atoll(m) : 0;
+            return v > 0 ? static_cast<std::size_t>(v) : kDefaultMaxMessage;
         }();
+        BufferPool buffers(max_message, kPooledReadBuffers);
+
+        std::function<void()> do_accept = [&] {
+            acceptor.async_accept([&](beast::error_code ec, tcp::socket socket) {
+                if (ec) {
+                    if (!acceptor.is_open()) return;
+                    std::cerr << "accept error: " << ec.message() << "\n";
+                } else {
+                    int token = active.enter(socket);
+                    std::thread([sock = std::move(socket), token, &manager, &db, &buffers, &active]() mutable {
+                        handle_connection(std::move(sock), manager, db, buffers);
+                        active.leave(token);
+                    }).detach();
+                }
+                do_accept();
+            });
+        };
 
-        tcp::acceptor acceptor(ioc, {tcp::v4(), static_cast<unsigned short>(port)});
-        std::cout << "Listening on port " << port << "\n";
+        // stop accepting and fall through to the drain below
+        std::function<void()> stop_serving = [&] {
+            beast::error_code ignored;
+            acceptor.close(ignored);
+            ioc.stop();
+        };
 
-        while (true) {
-            tcp::socket socket(ioc);
-            acceptor.accept(socket);
-            std::thread([sock = std::move(socket), &manager, &db]() mutable {
-                handle_connection(std::move(sock), manager, db);
-            }).detach();
+        bool open_later = false;
+#ifndef _WIN32
+        int ready_fd = env_fd("RESTART_READY_FD");
+        if (ready_fd >= 0 && backend == StorageBackend::Log) {
+            std::cout << "Opening the log once the previous process has drained\n";
+            db.open_async([ready_fd] { wait_for_predecessor(ready_fd); },
+                          [&](bool ok) {
+                              if (ok) return;
+                              std::cerr << "DB open failed\n";
+                              storage_failed = true;
+                              net::post(ioc, stop_serving);
+                          });
+            open_later = true;
+        } else if (ready_fd >= 0) {
+            ::close(ready_fd);
+        }
+#endif
+        if (!open_later && !db.open()) {
+            std::cerr << "DB open failed\n";
+            return 1;
         }
 
+        websocket::close_code close_code = websocket::close_code::going_away;
+        int successor_fd = -1;
+        net::signal_set signals(ioc, SIGINT, SIGTERM);
+#ifndef _WIN32
+        signals.add(SIGUSR2);
+#endif
+        std::function<void(beast::error_code, int)> on_signal = [&](beast::error_code ec, int sig) {
+            if (ec) return;
+#ifndef _WIN32
+            if (sig == SIGUSR2) {
+                successor_fd = self_exe.empty() ? -1 : spawn_successor(self_exe, argv, acceptor.native_handle());
+                if (successor_fd < 0) {
+                    std::cerr << "Hot restart failed, still serving\n";
+                    signals.async_wait(on_signal);
+                    return;
+                }
+                close_code = websocket::close_code::service_restart;
+            }
+#endif
+            std::cerr << "Signal " << sig << ": stopping accept and draining\n";
+            stop_serving();
+        };
+        signals.async_wait(on_signal);
+
+        do_accept();
+        ioc.run();
+
+        // Every websocket gets a close frame; connections still in the HTTP
+        // phase stop reading, so only slow responses are left to the timeout.
+        manager.close_all(close_code, kReconnectSpreadMs);
+        active.stop_reading();
+        bool idle = active.wait_idle(kDrainTimeout);
+        if (!idle) std::cerr << "Drain timed out with connections still open\n";
+        db.close();
+#ifndef _WIN32
+        if (successor_fd >= 0) ::close(successor_fd);
+#endif
+        std::cerr << "Shutdown complete\n";
+        // stragglers still hold references to manager/db on this stack
+        if (!idle) std::_Exit(storage_failed ? 1 : 0);
+        if (storage_failed) return 1;
+
     } catch (const std::exception& e) {
         std::cerr << "Fatal: " << e.what() << "\n";
         return 1;
@@ -2,28 +2,153 @@
 #include "sessionmanager.h"
 #include <iostream>
 #include <nlohmann/json.hpp>
+#include <random>
+#include <algorithm>
+
+#include <cstring>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/socket.h>
+#endif
+
+// targets per fan-out task; smaller rooms go out in a single task
+static constexpr std::size_t kBroadcastChunk = 256;
+// queued + running broadcasts per room before broadcast() blocks the sender
+static constexpr std::size_t kMaxInFlightPerRoom = 64;
+// idle room queues kept for reuse
+static constexpr std::size_t kMaxSpareQueues = 64;
+// messages a session may have waiting for its writer before it is dropped
+static constexpr std::size_t kMaxQueuedPerSession = 256;
+// threads waiting on full sockets and write deadlines; the sends themselves
+// never block, so a couple serve every session
+static constexpr unsigned kIoThreads = 2;
+// recycled message buffers: how many to keep, and the largest worth keeping
+static constexpr std::size_t kMaxSparePayloads = 256;
+static constexpr std::size_t kMaxSpareCapacity = 64 * 1024;
+// how long close_all waits for queued broadcasts before closing anyway
+static constexpr auto kFlushTimeout = std::chrono::seconds(2);
+// how long close_all gives writers, all together, to flush and send the close frame
+static constexpr auto kCloseWait = std::chrono::seconds(1);
+// a writer that can't get a byte onto its socket for this long is dropped
+static constexpr long long kWriteTimeoutMs = 5000;
+
+static long long steady_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+           std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#ifdef _WIN32
+static void shutdown_socket(const ws_ptr& ws) {
+    boost::system::error_code ec;
+    ws->next_layer().socket().shutdown(tcp::socket::shutdown_both, ec);
+}
+#endif
+
+// FIN + text opcode, unmasked, payload length in the shortest form
+static void encode_text_frame(std::string& out, std::string_view text) {
+    std::size_t n = text.size();
+    out.clear();
+    out.reserve(n + 10);
+    out += static_cast<char>(0x81);
+    if (n < 126) {
+        out += static_cast<char>(n);
+    } else if (n <= 0xFFFF) {
+        out += static_cast<char>(126);
+        out += static_cast<char>((n >> 8) & 0xFF);
+        out += static_cast<char>(n & 0xFF);
+    } else {
+        out += static_cast<char>(127);
+        for (int shift = 56; shift >= 0; shift -= 8)
+            out += static_cast<char>((static_cast<std::uint64_t>(n) >> shift) & 0xFF);
+    }
+    out.append(text.data(), text.size());
+}
+
+#ifndef _WIN32
+// Hands as much of `data` to the kernel as fits right now; never blocks.
+static std::size_t send_some(int fd, const char* data, std::size_t size, boost::system::error_code& ec) {
+    ssize_t n = ::send(fd, data, size, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (n >= 0) return static_cast<std::size_t>(n);
+    if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        ec.assign(errno, boost::system::system_category());
+    return 0;
+}
+#endif
+
+SessionManager::SessionManager(unsigned broadcast_threads)
+    : io_work_(net::make_work_guard(io_)),
+      executor_(broadcast_threads) {
+    for (unsigned i = 0; i < kIoThreads; ++i) io_threads_.emplace_back([this] { io_.run(); });
+}
+
+SessionManager::~SessionManager() {
+    // connection threads normally remove their own sessions; anything left
+    // still has a writer to finish
+    std::vector<std::shared_ptr<Writer>> left;
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        for (auto& kv : sessions_) left.push_back(kv.second.writer);
+    }
+    for (auto& w : left) stop_writer(w);
+    io_work_.reset();
+    io_.stop();
+    for (auto& t : io_threads_) t.join();
+}
+
+bool SessionManager::attach(ws_ptr ws) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (closing_) return false;
+    if (sessions_.count(ws.get())) return true;
+    // no name or room yet: not in rooms_ or by_username_ until add()
+    std::shared_ptr<Writer> writer = start_writer(ws);
+    if (!writer) return false;
+    sessions_.emplace(ws.get(), SessionInfo{ws, "", "", std::move(writer)});
+    return true;
+}
 
 void SessionManager::add(ws_ptr ws, const std::string& username, const std::string& room) {
     std::lock_guard<std::mutex> lock(mtx_);
     void* key = ws.get();
-    SessionInfo info{ws, username, room};
+    SessionInfo info{ws, username, room, nullptr};
+    // a re-join keeps the writer and whatever it has queued, and drops the
+    // old name/room: once this session is freed its key can be reused by a
+    // new connection, which must not inherit them
+    auto existing = sessions_.find(key);
+    if (existing != sessions_.end()) {
+        const SessionInfo& old = existing->second;
+        info.writer = old.writer;
+        if (!old.room.empty()) leave_room(old.room, key);
+        auto named = by_username_.find(old.username);
+        if (named != by_username_.end() && named->second == key) by_username_.erase(named);
+    } else {
+        info.writer = start_writer(ws);
+        if (!info.writer) return;
+    }
     sessions_[key] = info;
     rooms_[room].insert(key);
+    room_targets_.erase(room);
     by_username_[username] = key;
     std::cerr << "SessionManager::add user=" << username << " room=" << room << " ws=" << key << "\n";
 }
 
 void SessionManager::remove(ws_ptr ws) {
-    std::lock_guard<std::mutex> lock(mtx_);
-    void* key = ws.get();
-    auto it = sessions_.find(key);
-    if (it == sessions_.end()) return;
-    std::string room = it->second.room;
-    std::string username = it->second.username;
-    sessions_.erase(it);
-    rooms_[room].erase(key);
-    if (by_username_[username] == key) by_username_.erase(username);
-    std::cerr << "SessionManager::remove user=" << username << " room=" << room << " ws=" << key << "\n";
+    std::shared_ptr<Writer> writer;
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        void* key = ws.get();
+        auto it = sessions_.find(key);
+        if (it == sessions_.end()) return;
+        std::string room = it->second.room;
+        std::string username = it->second.username;
+        writer = it->second.writer;
+        sessions_.erase(it);
+        if (!room.empty()) leave_room(room, key);
+        auto named = by_username_.find(username);
+        if (named != by_username_.end() && named->second == key) by_username_.erase(named);
+        std::cerr << "SessionManager::remove user=" << username << " room=" << room << " ws=" << key << "\n";
+    }
+    stop_writer(writer);
 }
 
 void SessionManager::set_username(ws_ptr ws, const std::string& username) {
@@ -31,6 +156,8 @@ void SessionManager::set_username(ws_ptr ws, const std::string& username) {
     void* key = ws.get();
     auto it = sessions_.find(key);
     if (it != sessions_.end()) {
+        auto named = by_username_.find(it->second.username);
+        if (named != by_username_.end() && named->second == key) by_username_.erase(named);
         it->second.username = username;
         by_username_[username] = key;
     }
@@ -41,10 +168,10 @@ void SessionManager::set_room(ws_ptr ws, const std::string& room) {
     void* key = ws.get();
     auto it = sessions_.find(key);
     if (it != sessions_.end()) {
-        std::string old = it->second.room;
-        if (!old.empty()) rooms_[old].erase(key);
+        if (!it->second.room.empty()) leave_room(it->second.room, key);
         it->second.room = room;
         rooms_[room].insert(key);
+        room_targets_.erase(room);
     }
 }
 
@@ -60,47 +187,492 @@ std::vector<std::string> SessionManager::list_users(const std::string& room) {
     return out;
 }
 
-void SessionManager::broadcast(const std::string& room, const std::string& message, const ws_ptr exclude) {
-    std::vector<ws_ptr> targets;
+// caller holds mtx_
+void SessionManager::leave_room(const std::string& room, void* key) {
+    room_targets_.erase(room);
+    auto it = rooms_.find(room);
+    if (it == rooms_.end()) return;
+    it->second.erase(key);
+    if (it->second.empty()) rooms_.erase(it);
+}
+
+// nullptr for a room nobody is in; those are not cached
+SessionManager::TargetList SessionManager::room_targets(const std::string& room) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    auto cached = room_targets_.find(room);
+    if (cached != room_targets_.end()) return cached->second;
+
+    auto it = rooms_.find(room);
+    if (it == rooms_.end()) return nullptr;
+    auto list = std::make_shared<std::vector<Target>>();
+    list->reserve(it->second.size());
+    for (void* key : it->second) {
+        auto sit = sessions_.find(key);
+        if (sit != sessions_.end()) list->push_back(Target{sit->second.ws, sit->second.writer});
+    }
+    TargetList out = list;
+    room_targets_[room] = out;
+    return out;
+}
+
+// `encoded`: data is already a complete frame (one of beast's replies)
+SessionManager::PayloadPtr SessionManager::take_payload(std::string_view data, bool encoded) {
+    PayloadPtr p;
     {
-        std::lock_guard<std::mutex> lock(mtx_);
-        auto it = rooms_.find(room);
-        if (it == rooms_.end()) return;
-        for (void* key : it->second) {
-            auto sit = sessions_.find(key);
-            if (exclude && sit->second.ws == exclude) continue;
-            if (sit != sessions_.end()) targets.push_back(sit->second.ws);
+        std::lock_guard<std::mutex> lock(spare_mtx_);
+        if (!spare_payloads_.empty()) {
+            p = std::move(spare_payloads_.back());
+            spare_payloads_.pop_back();
+        }
+    }
+    if (!p) p = std::make_shared<Payload>();
+    if (encoded) p->frame.assign(data.data(), data.size());
+    else encode_text_frame(p->frame, data);
+    p->pending.store(1, std::memory_order_relaxed);   // the caller's reference
+    return p;
+}
+
+void SessionManager::release(PayloadPtr p) {
+    if (p->pending.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+    // last holder: keep the buffer unless it grew large
+    if (p->frame.capacity() > kMaxSpareCapacity) return;
+    std::lock_guard<std::mutex> lock(spare_mtx_);
+    if (spare_payloads_.size() < kMaxSparePayloads) spare_payloads_.push_back(std::move(p));
+}
+
+void SessionManager::broadcast(const std::string& room, std::string_view message, const ws_ptr exclude) {
+    TargetList targets = room_targets(room);
+    if (!targets || targets->empty()) return;
+
+    PayloadPtr payload = take_payload(message);
+    RoomQueue* q = nullptr;
+    {
+        std::unique_lock<std::mutex> lock(queue_mtx_);
+        auto it = queues_.find(room);
+        if (it == queues_.end()) {
+            if (!spare_queues_.empty()) {
+                RoomQueues::node_type node = std::move(spare_queues_.back());
+                spare_queues_.pop_back();
+                node.key() = room;
+                it = queues_.insert(std::move(node)).position;
+            } else {
+                it = queues_.emplace(room, RoomQueue{}).first;
+                it->second.ring.resize(kMaxInFlightPerRoom);
+            }
+            it->second.name = &it->first;
+        }
+        q = &it->second;
+        // backpressure: the sender's connection thread stalls here, which in
+        // turn stops it reading from its socket
+        ++q->waiters;
+        queue_cv_.wait(lock, [q] { return q->count < kMaxInFlightPerRoom; });
+        --q->waiters;
+        q->ring[(q->head + q->count) % kMaxInFlightPerRoom] = Broadcast{std::move(targets), std::move(payload), exclude};
+        ++q->count;
+        ++queued_;
+        if (q->count != 1) q = nullptr;   // already running
+    }
+    if (q) executor_.submit([this, q] { run_room(q); });
+}
+
+// Hands the room's front broadcast to every member's outbox, split into
+// chunks across the executor. The next broadcast for the room starts only
+// after every chunk finished, so a room's messages never reorder on any
+// socket. Sends here never block; what a socket doesn't take right away is
+// left to that session's writer.
+void SessionManager::run_room(RoomQueue* q) {
+    // the front slot is left alone by broadcast() until finish_room frees it
+    const Broadcast* b;
+    {
+        std::lock_guard<std::mutex> lock(queue_mtx_);
+        b = &q->ring[q->head];
+    }
+
+    std::size_t n = b->targets->size();
+    std::size_t chunks = (n + kBroadcastChunk - 1) / kBroadcastChunk;
+    if (chunks <= 1) {
+        write_range(*b, 0, n);
+        finish_room(q);
+        return;
+    }
+
+    auto remaining = std::make_shared<std::atomic<std::size_t>>(chunks);
+    auto chunk_done = [this, q, remaining] {
+        if (remaining->fetch_sub(1) == 1) finish_room(q);
+    };
+    for (std::size_t c = 1; c < chunks; ++c) {
+        std::size_t begin = c * kBroadcastChunk;
+        std::size_t end = std::min(n, begin + kBroadcastChunk);
+        executor_.submit([this, b, begin, end, chunk_done] {
+            write_range(*b, begin, end);
+            chunk_done();
+        });
+    }
+    // first chunk on this thread
+    write_range(*b, 0, kBroadcastChunk);
+    chunk_done();
+}
+
+void SessionManager::finish_room(RoomQueue* q) {
+    bool more = false;
+    PayloadPtr done;
+    {
+        std::lock_guard<std::mutex> lock(queue_mtx_);
+        done = std::move(q->ring[q->head].message);
+        q->ring[q->head] = Broadcast{};
+        q->head = (q->head + 1) % kMaxInFlightPerRoom;
+        --q->count;
+        --queued_;
+        more = q->count > 0;
+        if (!more && q->waiters == 0) {
+            // idle: nothing references q any more
+            RoomQueues::node_type node = queues_.extract(*q->name);
+            q->head = 0;
+            if (spare_queues_.size() < kMaxSpareQueues) spare_queues_.push_back(std::move(node));
         }
     }
+    queue_cv_.notify_all();
+    release(std::move(done));
+    // resubmit rather than loop so busy rooms take turns with the rest
+    if (more) executor_.submit([this, q] { run_room(q); });
+}
+
+void SessionManager::write_range(const Broadcast& b, std::size_t begin, std::size_t end) {
+    for (std::size_t i = begin; i < end; ++i) {
+        const Target& t = (*b.targets)[i];
+        if (b.exclude && t.ws == b.exclude) continue;
+        enqueue(t.writer, b.message);
+    }
+}
 
-    // write outside lock; catch errors per-socket
-    for (auto &wsp : targets) {
-        try {
-            wsp->text(true);
-            wsp->write(boost::asio::buffer(message));
-        } catch (const std::exception& e) {
-            std::cerr << "broadcast write error: " << e.what() << "\n";
-            // optionally remove this session asynchronously
+void SessionManager::enqueue(const std::shared_ptr<Writer>& w, const PayloadPtr& p) {
+    std::unique_lock<std::mutex> lock(w->mtx);
+    if (w->stop || w->closing) return;
+    if (w->count == 0 && !w->busy) {
+        w->busy = true;
+        std::size_t sent = 0;
+#ifndef _WIN32
+        // Nothing queued and nobody writing: send from this thread, which
+        // spares the I/O pool entirely for a client that keeps up.
+        lock.unlock();
+        boost::system::error_code ec;
+        sent = send_some(w->out.native_handle(), p->frame.data(), p->frame.size(), ec);
+        lock.lock();
+        if (ec) {
+            std::cerr << "write error: " << ec.message() << "\n";
+            w->stop = true;
+        } else if (sent == p->frame.size()) {
+            // others may have queued (or close_all asked for a close) meanwhile
+            bool more = w->count > 0 || w->closing || w->stop;
+            if (!more) w->busy = false;
+            lock.unlock();
+            if (more) kick(w);
+            return;
+        }
+#endif
+        if (!w->stop) {
+            // the rest goes out next, ahead of anything queued meanwhile
+            p->pending.fetch_add(1, std::memory_order_relaxed);
+            w->head = (w->head + kMaxQueuedPerSession - 1) % kMaxQueuedPerSession;
+            w->ring[w->head] = p;
+            w->head_sent = sent;
+            ++w->count;
         }
+        lock.unlock();
+        kick(w);
+        return;
+    }
+
+    if (w->count == kMaxQueuedPerSession) {
+        // the client isn't keeping up; once the socket is shut the connection
+        // thread exits and removes the session
+        std::cerr << "outbox full, dropping slow client ws=" << w->ws.get() << "\n";
+        halt(*w);
+        return;
     }
+    // busy is set while anything is queued, so whoever holds it sends this too
+    p->pending.fetch_add(1, std::memory_order_relaxed);
+    w->ring[(w->head + w->count) % kMaxQueuedPerSession] = p;
+    ++w->count;
 }
 
-void SessionManager::send_to_user(const std::string& username, const std::string& message) {
-    ws_ptr target;
+void SessionManager::send_to_user(const std::string& username, std::string_view message) {
+    SessionInfo target;
     {
         std::lock_guard<std::mutex> lock(mtx_);
         auto it = by_username_.find(username);
         if (it == by_username_.end()) return;
         void* key = it->second;
         auto sit = sessions_.find(key);
-        if (sit != sessions_.end()) target = sit->second.ws;
-    }
-    if (target) {
-        try {
-            target->text(true);
-            target->write(boost::asio::buffer(message));
-        } catch (const std::exception& e) {
-            std::cerr << "send_to_user error: " << e.what() << "\n";
+        if (sit != sessions_.end()) target = sit->second;
+    }
+    if (target.ws) {
+        PayloadPtr p = take_payload(message);
+        enqueue(target.writer, p);
+        release(std::move(p));
+    }
+}
+
+void SessionManager::send(ws_ptr ws, std::string_view message) {
+    std::shared_ptr<Writer> writer;
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        auto sit = sessions_.find(ws.get());
+        if (sit != sessions_.end()) writer = sit->second.writer;
+    }
+    // not attached: nobody else can be writing to this socket
+    if (!writer) {
+        ws->text(true);
+        ws->write(boost::asio::buffer(message.data(), message.size()));
+        return;
+    }
+    PayloadPtr p = take_payload(message);
+    enqueue(writer, p);
+    release(std::move(p));
+}
+
+std::shared_ptr<SessionManager::Writer> SessionManager::start_writer(const ws_ptr& ws) {
+    auto w = std::make_shared<Writer>(io_);
+    w->ws = ws;
+    w->ring.resize(kMaxQueuedPerSession);
+#ifndef _WIN32
+    int fd = ::fcntl(ws->next_layer().socket().native_handle(), F_DUPFD_CLOEXEC, 0);
+    boost::system::error_code ec;
+    if (fd >= 0) w->out.assign(fd, ec);
+    if (fd < 0 || ec) {
+        std::cerr << "writer setup failed: " << (ec ? ec.message() : std::string(std::strerror(errno))) << "\n";
+        if (fd >= 0 && !w->out.is_open()) ::close(fd);
+        return nullptr;
+    }
+#endif
+    // beast's own writes (pong, close replies) join the outbox; weak, since
+    // the writer holds the websocket
+    std::weak_ptr<Writer> weak = w;
+    ws->next_layer().set_outbox(SessionStream::Outbox{
+        [this, weak](std::string_view frame) {
+            std::shared_ptr<Writer> writer = weak.lock();
+            if (!writer) return;
+            PayloadPtr p = take_payload(frame, true);
+            enqueue(writer, p);
+            release(std::move(p));
+        },
+        [this, weak] {
+            std::shared_ptr<Writer> writer = weak.lock();
+            if (!writer) return false;
+            close_after_flush(writer);
+            return true;
+        }});
+    return w;
+}
+
+// beast finished a close handshake or failed the connection: send what is
+// queued, its close reply last, then shut the socket
+void SessionManager::close_after_flush(const std::shared_ptr<Writer>& w) {
+    {
+        std::lock_guard<std::mutex> lock(w->mtx);
+        if (w->done || w->closing) return;
+        w->closing = true;
+        if (w->busy) return;
+        w->busy = true;
+    }
+    kick(w);
+}
+
+// Drops whatever is queued; a writer already closing (close_all, or a close
+// handshake beast just finished) is left to finish its flush, bounded by
+// the write deadline.
+void SessionManager::stop_writer(const std::shared_ptr<Writer>& w) {
+    std::lock_guard<std::mutex> lock(w->mtx);
+    if (w->closing) return;
+    halt(*w);
+}
+
+// Continues a writer that has `busy` set. POSIX sends never block, so this
+// just runs on the caller; on Windows the blocking write goes to the pool.
+void SessionManager::kick(const std::shared_ptr<Writer>& w) {
+#ifndef _WIN32
+    pump(w);
+#else
+    net::post(io_, [this, w] { pump(w); });
+#endif
+}
+
+// Sends until the outbox (and then a pending close frame) is empty or the
+// socket is full; in the latter case waits on the I/O pool for the socket
+// to become writable and picks up from there. Only the holder of `busy`
+// runs this, so ring[head] and the sent offsets are its own.
+void SessionManager::pump(const std::shared_ptr<Writer>& w) {
+    std::unique_lock<std::mutex> lock(w->mtx);
+    while (!w->stop) {
+        const std::string* data;
+        std::size_t* sent;
+        if (w->count > 0) {
+            data = &w->ring[w->head]->frame;
+            sent = &w->head_sent;
+        } else if (w->closing) {
+            if (w->close_sent == w->close_frame.size()) break;
+            data = &w->close_frame;
+            sent = &w->close_sent;
+        } else {
+            w->busy = false;
+            w->guarded = false;
+            return;
+        }
+
+        std::size_t offset = *sent;
+        lock.unlock();
+        boost::system::error_code ec;
+#ifndef _WIN32
+        std::size_t n = send_some(w->out.native_handle(), data->data() + offset, data->size() - offset, ec);
+#else
+        std::size_t n = net::write(w->ws->next_layer().socket(), net::buffer(data->data() + offset, data->size() - offset), ec);
+#endif
+        lock.lock();
+        if (ec) {
+            std::cerr << "write error: " << ec.message() << "\n";
+            w->stop = true;
+            break;
+        }
+        if (n > 0) w->progress_ms = steady_ms();
+        *sent += n;
+        if (*sent == data->size()) {
+            if (sent == &w->head_sent) {
+                release(std::move(w->ring[w->head]));
+                w->head = (w->head + 1) % kMaxQueuedPerSession;
+                --w->count;
+                w->head_sent = 0;
+            }
+            continue;
+        }
+
+#ifndef _WIN32
+        // socket full: come back once it has room, within the deadline
+        guard(w);
+        w->out.async_wait(net::posix::stream_descriptor::wait_write,
+                          [this, w](const boost::system::error_code&) { pump(w); });
+        return;
+#endif
+    }
+    finish(*w);
+}
+
+// caller holds w.mtx. Ends the writer now when it is idle; otherwise the
+// holder of `busy` finishes it once its send fails or its wait is cancelled.
+void SessionManager::halt(Writer& w) {
+    if (w.done) return;
+    w.stop = true;
+    if (!w.busy) {
+        finish(w);
+        return;
+    }
+    boost::system::error_code ignored;
+#ifndef _WIN32
+    w.out.cancel(ignored);
+    ::shutdown(w.out.native_handle(), SHUT_RDWR);
+#else
+    shutdown_socket(w.ws);
+#endif
+}
+
+// caller holds w.mtx and either holds `busy` or found it clear. Drops the
+// outbox and shuts the socket, which also wakes the connection thread's
+// read so it removes the session.
+void SessionManager::finish(Writer& w) {
+    if (w.done) return;
+    w.stop = true;
+    w.busy = true;   // nothing is sent after this
+    for (; w.count > 0; --w.count) {
+        release(std::move(w.ring[w.head]));
+        w.head = (w.head + 1) % kMaxQueuedPerSession;
+    }
+    w.guarded = false;
+    boost::system::error_code ignored;
+    w.deadline.cancel(ignored);
+#ifndef _WIN32
+    w.out.cancel(ignored);
+    ::shutdown(w.out.native_handle(), SHUT_RDWR);
+#else
+    shutdown_socket(w.ws);
+#endif
+    w.done = true;
+    w.cv.notify_all();
+}
+
+// caller holds w->mtx. Starts the no-progress deadline for a writer about to
+// wait on its socket, unless one is already running for this stretch.
+void SessionManager::guard(const std::shared_ptr<Writer>& w) {
+    if (w->guarded) return;
+    w->guarded = true;
+    w->progress_ms = steady_ms();
+    std::uint64_t gen = ++w->deadline_gen;
+    w->deadline.expires_after(std::chrono::milliseconds(kWriteTimeoutMs));
+    w->deadline.async_wait([this, w, gen](const boost::system::error_code&) { check_deadline(w, gen); });
+}
+
+void SessionManager::check_deadline(const std::shared_ptr<Writer>& w, std::uint64_t gen) {
+    std::lock_guard<std::mutex> lock(w->mtx);
+    if (gen != w->deadline_gen || !w->guarded || w->done) return;
+    long long idle = steady_ms() - w->progress_ms;
+    if (idle < kWriteTimeoutMs) {
+        // bytes went out since the timer was set; wait out the remainder
+        w->deadline.expires_after(std::chrono::milliseconds(kWriteTimeoutMs - idle));
+        w->deadline.async_wait([this, w, gen](const boost::system::error_code&) { check_deadline(w, gen); });
+        return;
+    }
+    std::cerr << "write to ws=" << w->ws.get() << " timed out, dropping connection\n";
+    halt(*w);
+}
+
+void SessionManager::close_all(websocket::close_code code, int retry_spread_ms) {
+    {
+        std::unique_lock<std::mutex> lock(queue_mtx_);
+        if (!queue_cv_.wait_for(lock, kFlushTimeout, [this] { return queued_ == 0; }))
+            std::cerr << "close_all: " << queued_ << " broadcasts still queued\n";
+    }
+
+    std::vector<SessionInfo> targets;
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        closing_ = true;
+        for (auto& kv : sessions_) targets.push_back(kv.second);
+    }
+
+    std::mt19937 rng{std::random_device{}()};
+    std::uniform_int_distribution<int> jitter(0, std::max(retry_spread_ms, 0));
+
+    for (auto& t : targets) {
+        // server frames are unmasked and the reason is < 126 bytes
+        std::string reason = "retry-after=" + std::to_string(jitter(rng));
+        std::string frame;
+        frame += static_cast<char>(0x88);
+        frame += static_cast<char>(2 + reason.size());
+        frame += static_cast<char>((static_cast<unsigned>(code) >> 8) & 0xFF);
+        frame += static_cast<char>(static_cast<unsigned>(code) & 0xFF);
+        frame += reason;
+        Writer& w = *t.writer;
+        bool start = false;
+        {
+            std::lock_guard<std::mutex> lock(w.mtx);
+            if (w.done || w.closing) continue;
+            w.close_frame = std::move(frame);
+            w.closing = true;
+            // an idle writer is started here; a busy one gets to the close frame on its own
+            start = !w.busy;
+            if (start) w.busy = true;
+        }
+        if (start) kick(t.writer);
+    }
+
+    // One deadline for all writers; a writer still waiting on a client that
+    // stopped reading gets no close frame, and the shutdown below ends it.
+    auto until = std::chrono::steady_clock::now() + kCloseWait;
+    for (auto& t : targets) {
+        Writer& w = *t.writer;
+        std::unique_lock<std::mutex> lock(w.mtx);
+        if (!w.cv.wait_until(lock, until, [&w] { return w.done; })) {
+            std::cerr << "close_all: writer for " << t.username << " still blocked, closing without close frame\n";
+            halt(w);
         }
     }
+    std::cerr << "SessionManager::close_all closed " << targets.size() << " sessions\n";
 }
@@ -13,11 +13,18 @@
 #include <memory>
 #include <mutex>
 #include <thread>
+#include <atomic>
+#include <chrono>
 #include <set>
+#include <string_view>
 #include <unordered_set>
+#include <condition_variable>
+#include <functional>
 #include <iostream>
 #include <nlohmann/json.hpp>
 
+#include "broadcastexecutor.h"
+
 
 namespace beast = boost::beast;
 namespace websocket = beast::websocket;
@@ -26,28 +33,227 @@ namespace net = boost::asio;
 using tcp = asio::ip::tcp;
 
 using json = nlohmann::json;
-using ws_ptr = std::shared_ptr<websocket::stream<tcp::socket>>;
+
+// Next layer under every websocket. Reads go straight to the socket. Writes
+// do too until SessionManager::attach installs the session's outbox; from
+// then on they are queued there, so the pong and close replies beast writes
+// from inside read() go out between whole frames of the session's writer
+// instead of interleaving with them on the wire.
+class SessionStream {
+public:
+    using executor_type = tcp::socket::executor_type;
+
+    // Both run on the connection thread, from inside beast. `write` queues
+    // one complete frame; `close` flushes the outbox, then shuts the socket,
+    // and returns false when there is no outbox (left to the plain socket).
+    struct Outbox {
+        std::function<void(std::string_view)> write;
+        std::function<bool()> close;
+    };
+
+    explicit SessionStream(tcp::socket socket) : socket_(std::move(socket)) {}
+
+    executor_type get_executor() { return socket_.get_executor(); }
+    tcp::socket& socket() { return socket_; }
+    void set_outbox(Outbox outbox) { outbox_ = std::move(outbox); }
+    bool close_outbox() { return outbox_.close && outbox_.close(); }
+
+    template <class MutableBufferSequence>
+    std::size_t read_some(const MutableBufferSequence& buffers) {
+        return socket_.read_some(buffers);
+    }
+    template <class MutableBufferSequence>
+    std::size_t read_some(const MutableBufferSequence& buffers, beast::error_code& ec) {
+        return socket_.read_some(buffers, ec);
+    }
+    template <class ConstBufferSequence>
+    std::size_t write_some(const ConstBufferSequence& buffers) {
+        beast::error_code ec;
+        std::size_t n = write_some(buffers, ec);
+        if (ec) throw beast::system_error(ec);
+        return n;
+    }
+    template <class ConstBufferSequence>
+    std::size_t write_some(const ConstBufferSequence& buffers, beast::error_code& ec) {
+        if (!outbox_.write) return socket_.write_some(buffers, ec);
+        // beast hands over a whole frame per call; take all of it
+        scratch_.resize(net::buffer_size(buffers));
+        net::buffer_copy(net::buffer(&scratch_[0], scratch_.size()), buffers);
+        outbox_.write(scratch_);
+        ec = {};
+        return scratch_.size();
+    }
+
+    template <class MutableBufferSequence, class ReadHandler>
+    auto async_read_some(const MutableBufferSequence& buffers, ReadHandler&& handler) {
+        return socket_.async_read_some(buffers, std::forward<ReadHandler>(handler));
+    }
+    template <class ConstBufferSequence, class WriteHandler>
+    auto async_write_some(const ConstBufferSequence& buffers, WriteHandler&& handler) {
+        return socket_.async_write_some(buffers, std::forward<WriteHandler>(handler));
+    }
+
+private:
+    tcp::socket socket_;
+    Outbox outbox_;
+    std::string scratch_;
+};
+
+// Found by beast through ADL once a close handshake or failure is done: with
+// an outbox the writer shuts the socket after what is queued (the close
+// reply included) has gone out.
+inline void teardown(beast::role_type role, SessionStream& stream, beast::error_code& ec) {
+    if (stream.close_outbox()) {
+        ec = {};
+        return;
+    }
+    websocket::teardown(role, stream.socket(), ec);
+}
+
+template <class TeardownHandler>
+void async_teardown(beast::role_type role, SessionStream& stream, TeardownHandler&& handler) {
+    websocket::async_teardown(role, stream.socket(), std::forward<TeardownHandler>(handler));
+}
+
+using ws_ptr = std::shared_ptr<websocket::stream<SessionStream>>;
 
 class SessionManager {
 public:
-    SessionManager() = default;
-    ~SessionManager() = default;
+    explicit SessionManager(unsigned broadcast_threads = std::thread::hardware_concurrency());
+    ~SessionManager();
 
+    // register a websocket as soon as it is accepted, before it joins, so
+    // close_all reaches it too; false once close_all has started
+    bool attach(ws_ptr ws);
     void add(ws_ptr ws, const std::string& username, const std::string& room);
     void remove(ws_ptr ws);
     void set_username(ws_ptr ws, const std::string& username);
     void set_room(ws_ptr ws, const std::string& room);
     std::vector<std::string> list_users(const std::string& room);
-    void broadcast(const std::string& room, const std::string& message, const ws_ptr exclude = nullptr);
-    void send_to_user(const std::string& username, const std::string& message);
+    // Queued onto the broadcast executor; returns once queued, not once
+    // written. Broadcasts to one room are delivered in call order. Blocks
+    // while the room already has kMaxInFlightPerRoom broadcasts queued.
+    void broadcast(const std::string& room, std::string_view message, const ws_ptr exclude = nullptr);
+    void send_to_user(const std::string& username, std::string_view message);
+    // queued behind whatever the session's writer already has
+    void send(ws_ptr ws, std::string_view message);
+    // shutdown/drain: let queued broadcasts go out, then have every writer
+    // flush its outbox and send a close frame carrying "retry-after=<ms>"
+    // (ms jittered over [0, retry_spread_ms]) before shutting the socket so
+    // the connection thread wakes up and exits. Writers still stuck after
+    // kCloseWait are shut down without a close frame.
+    void close_all(websocket::close_code code, int retry_spread_ms);
 
 private:
+    // A message on its way to one or more sessions, already encoded as a
+    // websocket text frame (server frames are unmasked, so one encoding
+    // serves every recipient). `pending` counts the holders still to release
+    // it (the sender plus each outbox it sits in); the last release hands the
+    // buffer back to spare_payloads_.
+    struct Payload {
+        std::string frame;
+        std::atomic<std::size_t> pending{0};
+    };
+    using PayloadPtr = std::shared_ptr<Payload>;
+
+    // Write side of a session. Nothing here blocks: enqueue() sends straight
+    // from the calling thread while the outbox is empty, and whatever the
+    // socket doesn't take waits in a bounded outbox. pump() drains it with
+    // non-blocking sends and, when the socket is full, waits for it to
+    // become writable on the I/O pool, so a client that stops reading holds
+    // no thread at all. A session whose outbox overflows, or that makes no
+    // progress for kWriteTimeoutMs, is disconnected.
+    struct Writer {
+        explicit Writer(net::io_context& io) : deadline(io)
+#ifndef _WIN32
+            , out(io)
+#endif
+        {}
+
+        ws_ptr ws;
+        std::mutex mtx;
+        std::condition_variable cv;   // close_all waits here for `done`
+        std::vector<PayloadPtr> ring;   // kMaxQueuedPerSession slots
+        std::size_t head = 0;
+        std::size_t count = 0;
+        std::size_t head_sent = 0;   // bytes of ring[head] already on the socket
+        bool busy = false;       // a send or a writability wait is in progress
+        bool stop = false;       // finish, dropping whatever is queued
+        bool closing = false;    // finish once the outbox and close_frame are out
+        bool done = false;       // finished and the socket shut down
+        std::string close_frame;     // empty: just shut down after the flush
+        std::size_t close_sent = 0;
+        // no-progress timeout while waiting on the socket; stale timer
+        // callbacks are told apart by generation
+        bool guarded = false;
+        std::uint64_t deadline_gen = 0;
+        long long progress_ms = 0;
+        net::steady_timer deadline;
+#ifndef _WIN32
+        // a dup of the socket, owned by the I/O pool: the connection thread
+        // keeps the socket object to itself
+        net::posix::stream_descriptor out;
+#endif
+    };
+
     struct SessionInfo {
         ws_ptr ws;
         std::string username;
         std::string room;
+        std::shared_ptr<Writer> writer;
     };
 
+    // what fan-out needs from a session, shared by every broadcast to a room
+    struct Target {
+        ws_ptr ws;
+        std::shared_ptr<Writer> writer;
+    };
+    using TargetList = std::shared_ptr<const std::vector<Target>>;
+
+    struct Broadcast {
+        TargetList targets;
+        PayloadPtr message;
+        ws_ptr exclude;
+    };
+
+    // Per-room FIFO as a fixed ring of kMaxInFlightPerRoom slots.
+    // ring[head] is the broadcast currently being fanned out. A queue lives
+    // in queues_ only while it has broadcasts or waiting senders, so the
+    // RoomQueue* captured by executor tasks stays valid; its map node is
+    // then parked in spare_queues_ so busy rooms don't allocate.
+    struct RoomQueue {
+        std::vector<Broadcast> ring;
+        std::size_t head = 0;
+        std::size_t count = 0;
+        std::size_t waiters = 0;             // senders blocked on a full ring
+        const std::string* name = nullptr;   // this queue's key in queues_
+    };
+    using RoomQueues = std::unordered_map<std::string, RoomQueue>;
+
+    std::shared_ptr<Writer> start_writer(const ws_ptr& ws);
+    void stop_writer(const std::shared_ptr<Writer>& w);
+    void close_after_flush(const std::shared_ptr<Writer>& w);
+    void enqueue(const std::shared_ptr<Writer>& w, const PayloadPtr& p);
+    void pump(const std::shared_ptr<Writer>& w);
+    void kick(const std::shared_ptr<Writer>& w);
+    void halt(Writer& w);
+    void finish(Writer& w);
+    void guard(const std::shared_ptr<Writer>& w);
+    void check_deadline(const std::shared_ptr<Writer>& w, std::uint64_t gen);
+    PayloadPtr take_payload(std::string_view data, bool encoded = false);
+    void release(PayloadPtr p);
+    TargetList room_targets(const std::string& room);
+    void run_room(RoomQueue* q);
+    void finish_room(RoomQueue* q);
+    void write_range(const Broadcast& b, std::size_t begin, std::size_t end);
+    void leave_room(const std::string& room, void* key);
+
+    // Waits for writable sockets and write deadlines. First member: writers
+    // hold timers and descriptors on it, so it has to outlive all of them.
+    net::io_context io_;
+    net::executor_work_guard<net::io_context::executor_type> io_work_;
+    std::vector<std::thread> io_threads_;
+
     std::mutex mtx_;
     // map ws.get() pointer address string (or use ws_ptr) -> info
     std::unordered_map<void*, SessionInfo> sessions_;
@@ -55,6 +261,23 @@ private:
     std::unordered_map<std::string, std::unordered_set<void*>> rooms_;
     // username -> ws pointer (one-to-one in this simple model)
     std::unordered_map<std::string, void*> by_username_;
+    // room -> cached fan-out list, dropped whenever membership changes;
+    // rooms without members are in neither map
+    std::unordered_map<std::string, TargetList> room_targets_;
+    bool closing_ = false;
+
+    std::mutex queue_mtx_;
+    std::condition_variable queue_cv_;
+    RoomQueues queues_;
+    std::vector<RoomQueues::node_type> spare_queues_;
+    std::size_t queued_ = 0;    // across all rooms
+
+    // buffers of delivered messages, reused so steady-state sends don't allocate
+    std::mutex spare_mtx_;
+    std::vector<PayloadPtr> spare_payloads_;
+
+    // last member: destroyed first, so queued tasks still see the state above
+    BroadcastExecutor executor_;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,36 @@
+#ifndef SQLITESTORE_H
+#define SQLITESTORE_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <sqlite3.h>
+
+#include "database.h"
+
+// Default backend: one row per message in a WAL-mode SQLite file.
+class SqliteStore : public MessageStore {
+public:
+    SqliteStore(const std::string& path);
+    ~SqliteStore() override;
+
+    SqliteStore(const SqliteStore&) = delete;
+    SqliteStore& operator=(const SqliteStore&) = delete;
+
+    bool open() override;
+    bool close() override;
+    std::vector<ChatMessage> get_recent_messages(const std::string &room, int limit) override;
+    void insert_message(const std::string& room, const std::string& username, const std::string& text, long long ts) override;
+private:
+    bool ensure_table();
+    bool prepare_statements();
+
+    std::string path_;
+    sqlite3* db_ = nullptr;
+    // prepared once in open(), reset and rebound per call under mtx_
+    sqlite3_stmt* insert_stmt_ = nullptr;
+    sqlite3_stmt* recent_stmt_ = nullptr;
+    std::mutex mtx_;
+};
+
+#endif